@@ -6,13 +6,23 @@
 #include <thread>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <atomic>
 #include <unordered_map>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <mutex>
+#include <shared_mutex>
+#include <cstdint>
 #include <vector>
+#include <deque>
+#include <future>
 
 #include "pzmq_data.h"
+#include "pzmq_context.hpp"
+#include "pzmq_rpc_pool.hpp"
+#include "pzmq_rpc_async.hpp"
+#include "pzmq_reactor.hpp"
 
 #define ZMQ_RPC_FUN (ZMQ_REP | 0x80)
 #define ZMQ_RPC_CALL (ZMQ_REQ | 0x80)
@@ -23,21 +33,46 @@ class pzmq {
 public:
     using rpc_callback_fun = std::function<std::string(pzmq *, const std::shared_ptr<pzmq_data> &)>;
     using msg_callback_fun = std::function<void(pzmq *, const std::shared_ptr<pzmq_data> &)>;
+    using rpc_async_callback = pzmq_rpc_async::async_callback;
 
 public:
     const int rpc_url_head_length = 6;
-    std::string rpc_url_head_ = "ipc:///tpm/rpc.";
-    void *zmq_ctx_;
+    std::string rpc_url_head_ = "ipc:///tmp/rpc.";
+    void *zmq_ctx_; // 进程共享的上下文（pzmq_context），creat 时取得引用，close_zmq 时归还
     void *zmq_socket_;
+    int wake_fd_; // 析构时写入，唤醒阻塞在 zmq_poll 上的事件循环、分发线程和工作线程
     std::unordered_map<std::string, rpc_callback_fun> zmq_fun_;
-    std::mutex zmq_fun_mtx_;
+    std::shared_mutex zmq_fun_mtx_;
     std::atomic<bool> flage_;
     std::unique_ptr<std::thread> zmq_thread_;
+    int reactor_id_; // 注册到 pzmq_reactor 时的源 ID，-1 表示使用自己的 zmq_thread_
+    int rpc_workers_;
+    void *zmq_backend_;
+    std::vector<std::unique_ptr<std::thread>> zmq_workers_;
+    pzmq_data_pool data_pool_; // zmq_event_loop 线程专用的消息对象池
     int mode_;
     std::string rpc_server_;
     std::string zmq_url_;
     int timeout_;
 
+    // 发送 blob 从 offset 开始的部分，数据块的引用交给 libzmq，发送完成后释放
+    int send_blob(const std::shared_ptr<const std::string>& blob, size_t offset, int flags) {
+        size_t length = blob->length() - offset;
+        if (length < zero_copy_threshold) {
+            return zmq_send(zmq_socket_, blob->data() + offset, length, flags);
+        }
+        auto *owned = new std::shared_ptr<const std::string>(blob);
+        zmq_msg_t msg;
+        zmq_msg_init_data(&msg, const_cast<char *>(blob->data()) + offset, length,
+                          [](void *, void *hint) { delete static_cast<std::shared_ptr<const std::string> *>(hint); },
+                          owned);
+        int ret = zmq_msg_send(&msg, zmq_socket_, flags);
+        if (ret < 0) {
+            zmq_msg_close(&msg);
+        }
+        return ret;
+    }
+
     bool is_bind() {
         if ((mode_ == ZMQ_PUB) || (mode_ == ZMQ_PULL) || (mode_ == ZMQ_RPC_FUN)) {
             return true;
@@ -57,24 +92,34 @@ public:
      * 
      * 构造时设为空：zmq_ctx_(NULL), zmq_socket_(NULL) 表示构造函数执行时不创建任何 ZMQ 资源
      * 延迟到使用时：真正的 ZMQ 上下文和套接字创建会推迟到调用 register_rpc_action() 或 call_rpc_action() 等方法时
-     * 按需分配：只有当程序真正需要进行 RPC 通信时，才会调用 zmq_ctx_new() 和 zmq_socket() 创建实际资源
+     * 按需分配：只有当程序真正需要进行 RPC 通信时，才会从 pzmq_context 取得共享上下文并调用 zmq_socket() 创建实际资源
      * 所以 NULL 值就是惰性初始化的标志，表示"资源尚未创建，等需要时再说"。
      */
     pzmq(const std::string &server) 
-        : zmq_ctx_(NULL), zmq_socket_(NULL), rpc_server_(server), flage_(true), timeout_(3000) {
+        : zmq_ctx_(NULL), zmq_socket_(NULL), wake_fd_(-1), rpc_server_(server), flage_(true), timeout_(3000),
+          reactor_id_(-1), rpc_workers_(0), zmq_backend_(NULL) {
         if (server.find("://") != std::string::npos) {
             rpc_url_head_.clear();
+        } else if (pzmq_context::instance().inproc()) {
+            // 嵌入模式：RPC 服务也走 inproc://，没有套接字文件，不做文件检查
+            rpc_server_ = pzmq_context::instance().local_url(rpc_url_head_ + server);
+            rpc_url_head_.clear();
         }
     }
 
     // 具体通信模式创建
     pzmq(const std::string &url, int mode, const msg_callback_fun &raw_call = nullptr)
-        : zmq_ctx_(NULL), zmq_socket_(NULL), mode_(mode), flage_(true), timeout_(3000) {
-        if ((url[0] != 'i') && (url[1] != 'p')) {
+        : zmq_ctx_(NULL), zmq_socket_(NULL), wake_fd_(-1), mode_(mode), flage_(true), timeout_(3000),
+          reactor_id_(-1), rpc_workers_(0), zmq_backend_(NULL) {
+        // 嵌入模式下 ipc:// 改写成 inproc://，调用者拿到的地址不变
+        std::string local_url = pzmq_context::instance().local_url(url);
+
+        // 只有 ipc:// 地址对应套接字文件，tcp:// 和 inproc:// 不做文件检查和清理
+        if (local_url.compare(0, 6, "ipc://") != 0) {
             rpc_url_head_.clear();
         }
         if (mode_ != ZMQ_RPC_FUN) {
-            creat(url, raw_call);
+            creat(local_url, raw_call);
         }
     }
 
@@ -86,6 +131,29 @@ public:
         return timeout_;
     }
 
+    /**
+     * 设置 RPC 服务端的工作线程数，必须在第一次 register_rpc_action() 之前调用：
+     * count <= 0：默认模式，单个 REP 套接字 + 单线程串行处理所有请求
+     * count > 0：多工作线程模式，ROUTER 绑定服务地址，通过 inproc 的 DEALER
+     *            把请求分发给 count 个 REP 工作线程并发处理，慢的 action 不会阻塞其它 action
+     */
+    void set_rpc_workers(int count) {
+        rpc_workers_ = count;
+    }
+
+    int get_rpc_workers() {
+        return rpc_workers_;
+    }
+
+    // zmq_event_loop 消息对象池的命中和未命中次数，注册到 pzmq_reactor 时见 pzmq_reactor::pool_hits()
+    uint64_t pool_hits() const {
+        return data_pool_.hits();
+    }
+
+    uint64_t pool_misses() const {
+        return data_pool_.misses();
+    }
+
     /**
      * 这个函数是用来列出当前 RPC 服务器注册的所有可用函数的：
      * 功能：
@@ -114,6 +182,7 @@ public:
      */
     std::string _rpc_list_action(pzmq *self, const std::shared_ptr<pzmq_data>& _None) {
         std::string action_list;
+        std::shared_lock<std::shared_mutex> lock(zmq_fun_mtx_);
 
         /**
          * 预分配内存空间：为action_list这个vector容器预先分配能容纳128个元素的内存空间
@@ -140,7 +209,7 @@ public:
 
     int register_rpc_action(const std::string& action, const rpc_callback_fun& raw_call) {
         int ret = 0;
-        std::unique_lock<std::mutex> lock(zmq_fun_mtx_);
+        std::unique_lock<std::shared_mutex> lock(zmq_fun_mtx_);
         if (zmq_fun_.find(action) != zmq_fun_.end()) {
             zmq_fun_[action] = raw_call;
 
@@ -162,6 +231,7 @@ public:
          */
         if (zmq_fun_.empty()) {
             std::string url = rpc_url_head_ + rpc_server_;
+            mode_ = ZMQ_RPC_FUN;
             zmq_fun_["list_action"] = 
                 std::bind(&pzmq::_rpc_list_action, this, std::placeholders::_1, std::placeholders::_2);
             ret = creat(url);
@@ -172,7 +242,7 @@ public:
     }
 
     void unregister_rpc_action(const std::string& action) {
-        std::unique_lock<std::mutex> lock(zmq_fun_mtx_);
+        std::unique_lock<std::shared_mutex> lock(zmq_fun_mtx_);
         if (zmq_fun_.find(action) != zmq_fun_.end()) {
             zmq_fun_.erase(action);
         }
@@ -180,70 +250,122 @@ public:
 
     /**
      * 这个  call_rpc_action 函数是 RPC 客户端调用远程函数的核心方法
-     * 这是一个同步 RPC 调用：发送请求 → 等待响应 → 处理结果 → 清理资源
+     * 这是一个同步 RPC 调用：借出连接 → 发送请求 → 等待响应 → 归还连接 → 处理结果
+     *
+     * 连接不再每次创建和销毁，而是从进程级的 pzmq_rpc_pool 中借出已连接的 REQ 套接字，
+     * 调用成功后归还复用，失败（超时等）时丢弃，下次调用自动重连
+     * 返回值：成功返回 0，服务不可用或调用失败返回 -1（此时不会调用 raw_call）
      */
     int call_rpc_action(const std::string& action, 
         const std::string& data, const msg_callback_fun& raw_call) {
-        int ret;
-        std::shared_ptr<pzmq_data> msg_ptr = std::make_shared<pzmq_data>();
-        try {
+        if (rpc_server_.empty()) {
+            return -1;
+        }
+        std::string url = rpc_url_head_ + rpc_server_;
+        std::string socket_file;
+        if (!rpc_url_head_.empty()) {
+            socket_file = url.substr(rpc_url_head_length);
+        }
 
-            // 惰性初始化检查：
-            if (NULL == zmq_socket) {
-                if (rpc_server_.empty()) {
-                    return -1;
-                }
-                std::string url = rpc_url_head_ + rpc_server_;
-                mode_ = ZMQ_RPC_CALL;
-                ret = creat(url);
-                if (ret) {
-                    throw ret;
-                }
-            }
+        // 借出连接
+        pzmq_rpc_pool &pool = pzmq_rpc_pool::instance();
+        int timeout = timeout_;
+        void *socket = pool.acquire(url, socket_file, timeout);
+        if (NULL == socket) {
+            return -1;
+        }
 
-            /**
-             * 发送请求
-             * 先发送函数名（带  ZMQ_SNDMORE 标志表示还有更多数据）
-             * 再发送参数数据
-             */
-            {
-                zmq_send(zmq_socket_, action.c_str(), action.length(), ZMQ_SNDMORE);
-                zmq_send(zmq_socket_, data.c_str(), data.length(), 0);
-            }
+        /**
+         * 发送请求
+         * 先发送函数名（带  ZMQ_SNDMORE 标志表示还有更多数据）
+         * 再发送参数数据
+         * 然后接收响应
+         */
+        int ret = -1;
+        std::shared_ptr<pzmq_data> msg_ptr = std::make_shared<pzmq_data>();
+        if ((zmq_send(socket, action.c_str(), action.length(), ZMQ_SNDMORE) >= 0) &&
+            (zmq_send(socket, data.c_str(), data.length(), 0) >= 0) &&
+            (zmq_msg_recv(msg_ptr->get(), socket, 0) >= 0)) {
+            ret = 0;
+        }
 
-            // 接收响应
-            {
-                zmq_msg_recv(msg_ptr->get(), zmq_socket_, 0);
-            }
+        // 先归还连接再处理结果，回调里可以再次发起 RPC 调用
+        pool.release(url, socket, timeout, ret == 0);
 
-            // 处理响应，调用回调函数处理服务器返回的结果
+        // 处理响应，调用回调函数处理服务器返回的结果
+        if (ret == 0) {
             raw_call(this, msg_ptr);
-        } catch (int e) {
-            ret = e;
         }
 
-        // 清理资源
-        msg_ptr.reset();
-        close_zmq();
-
         return ret;
     }
 
+    /**
+     * 异步 RPC 调用：立即返回，不等待响应
+     * 请求通过进程级的 pzmq_rpc_async 客户端发送，同一个服务的所有异步请求复用一个 DEALER 连接，
+     * 可以同时发起多个调用，响应按请求 ID 匹配
+     *
+     * raw_call(ret, data)：ret 为 0 时 data 是服务端的响应，-1 表示服务不可用、发送失败或超时
+     * 回调在异步客户端的 io 线程中执行，pzmq 对象本身不需要活到回调发生
+     * 返回值：请求已提交返回 0，服务不可用返回 -1（此时不会调用 raw_call，与 call_rpc_action 一致）
+     */
+    int call_rpc_action_async(const std::string& action,
+        const std::string& data, const rpc_async_callback& raw_call) {
+        if (rpc_server_.empty()) {
+            return -1;
+        }
+        std::string url = rpc_url_head_ + rpc_server_;
+        if (!rpc_url_head_.empty()) {
+            std::string socket_file = url.substr(rpc_url_head_length);
+            if (access(socket_file.c_str(), F_OK) != 0) {
+                return -1;
+            }
+        }
+        pzmq_rpc_async::instance(url)->call(action, data, timeout_, raw_call);
+
+        return 0;
+    }
+
+    /**
+     * future 形式的异步 RPC 调用，失败或超时时 future 的值为 nullptr
+     * 示例：
+     * auto f1 = _call.call_rpc_action_async("sql_select", "a");
+     * auto f2 = _call.call_rpc_action_async("sql_select", "b");
+     * auto a = f1.get(); auto b = f2.get(); // 两个请求同时在途
+     */
+    std::future<std::shared_ptr<pzmq_data>> call_rpc_action_async(const std::string& action,
+        const std::string& data) {
+        auto promise = std::make_shared<std::promise<std::shared_ptr<pzmq_data>>>();
+        std::future<std::shared_ptr<pzmq_data>> result = promise->get_future();
+        int ret = call_rpc_action_async(action, data, [promise](int ret, const std::shared_ptr<pzmq_data> &raw) {
+            promise->set_value(ret == 0 ? raw : nullptr);
+        });
+        if (ret != 0) {
+            promise->set_value(nullptr);
+        }
+
+        return result;
+    }
+
     /**
      * 这个  creat 函数是创建 ZMQ 套接字和连接的核心方法：
      * 主要功能：
      * 保存 URL：zmq_url_ = url
-     * 创建 ZMQ 上下文：循环调用 zmq_ctx_new() 直到成功
+     * 取得 ZMQ 上下文：引用进程共享的 pzmq_context，不再每个对象创建一个
      * 创建套接字：根据模式创建对应类型的套接字
      * 根据模式分发：调用不同的具体创建方法
      */
     int creat(const std::string &url, const msg_callback_fun &raw_call = nullptr) {
         zmq_url_= url;
+        zmq_ctx_ = pzmq_context::instance().acquire();
+        wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        // 提取低6位，去掉自定义标志位；多工作线程的 RPC 服务端前端使用 ROUTER
+        int socket_type = mode_ & 0x3f;
+        if ((mode_ == ZMQ_RPC_FUN) && (rpc_workers_ > 0)) {
+            socket_type = ZMQ_ROUTER;
+        }
         do {
-            zmq_ctx_ = zmq_ctx_new();
-        } while (zmq_ctx_ == NULL);
-        do { // 提取低6位，去掉自定义标志位
-            zmq_socket_ = zmq_socket(zmq_ctx_, mode_ & 0x3f);
+            zmq_socket_ = zmq_socket(zmq_ctx_, socket_type);
         } while (zmq_socket_ == NULL);
 
         switch (mode_) {
@@ -259,7 +381,10 @@ public:
             case ZMQ_PULL: { // 拉取模式
                 return creat_pull(url, raw_call);
             } break;
-            case ZMQ_RPC_FUN: { // RPC 服务端（REP）
+            case ZMQ_RPC_FUN: { // RPC 服务端（REP 或 ROUTER + 工作线程）
+                if (rpc_workers_ > 0) {
+                    return creat_router(url);
+                }
                 return creat_rep(url, raw_call);
             } break;
             case ZMQ_RPC_CALL: { // RPC 客户端（REQ）
@@ -276,6 +401,68 @@ public:
         return zmq_send(zmq_socket_, raw.c_str(), raw.length(), 0);
     }
 
+    /**
+     * 零拷贝发送：
+     * zmq_send 会把数据拷贝进 ZMQ 消息，对音频帧、embedding 这类大负载来说这次 memcpy 很浪费
+     * 下面几个重载把调用者交出的缓冲区直接交给 libzmq（zmq_msg_init_data），
+     * libzmq 发送完成后在自己的线程里调用释放回调归还缓冲区
+     *
+     * 小于 zero_copy_threshold 的数据仍然走 zmq_send 拷贝，
+     * 小消息拷贝比分配释放回调、跨线程释放更便宜（ZMQ 对很小的消息本来也是内联存储）
+     */
+    static constexpr size_t zero_copy_threshold = 1024;
+
+    // 发送被移动进来的字符串，字符串的所有权交给 libzmq
+    int send_data(std::string&& raw) {
+        if (raw.length() < zero_copy_threshold) {
+            return zmq_send(zmq_socket_, raw.c_str(), raw.length(), 0);
+        }
+        std::string *owned = new std::string(std::move(raw));
+        zmq_msg_t msg;
+        zmq_msg_init_data(&msg, owned->data(), owned->length(),
+                          [](void *, void *hint) { delete static_cast<std::string *>(hint); }, owned);
+        int ret = zmq_msg_send(&msg, zmq_socket_, 0);
+        if (ret < 0) {
+            zmq_msg_close(&msg);
+        }
+        return ret;
+    }
+
+    // 发送引用计数的数据块，同一块数据可以发给多个套接字（如 PUB 和用户 PUSH）而不拷贝
+    int send_data(const std::shared_ptr<const std::string>& blob) {
+        return send_blob(blob, 0, 0);
+    }
+
+    /**
+     * 两帧发送，两帧放在同一个数据块里：[0, head_len) 是 head，之后是 body
+     * 调用者只需要分配、拷贝一次；head 很短，拷贝发送，body 按 send_data(blob) 的规则零拷贝
+     */
+    int send_data(const std::shared_ptr<const std::string>& blob, size_t head_len) {
+        if (head_len == 0) {
+            return send_blob(blob, 0, 0);
+        }
+        if (zmq_send(zmq_socket_, blob->data(), head_len, ZMQ_SNDMORE) < 0) {
+            return -1;
+        }
+        return send_blob(blob, head_len, 0);
+    }
+
+    // 直接转发收到的消息，消息内容的所有权转移给 libzmq，发送后 data 变为空消息
+    int send_data(pzmq_data&& data) {
+        return zmq_msg_send(data.get(), zmq_socket_, 0);
+    }
+
+    /**
+     * 两帧发送：[head][body]，head 带 ZMQ_SNDMORE，两帧作为一条消息原子地送达
+     * 用于在不改动负载的情况下附带路由信息，接收端的事件循环把 head 挂在 body 上（pzmq_data::head()）
+     */
+    int send_data(std::string_view head, std::string_view body) {
+        if (zmq_send(zmq_socket_, head.data(), head.size(), ZMQ_SNDMORE) < 0) {
+            return -1;
+        }
+        return zmq_send(zmq_socket_, body.data(), body.size(), 0);
+    }
+
     /**
      * 功能：
      * 将 ZMQ 套接字绑定到指定的 URL 地址
@@ -342,16 +529,13 @@ public:
      * flage_ = false 表示套接字已就绪
      * 可能用于控制事件循环的运行状态
      * 
-     * 3. 创建后台线程：
-     * zmq_thread_ = std::make_unique<std::thread>(std::bind(&pzmq::zmq_event_loop, this, raw_call));
-     * 创建一个独立线程运行 zmq_event_loop 方法
+     * 3. 启动接收：start_event_loop(raw_call)
+     * 创建一个独立线程运行 zmq_event_loop 方法，或者注册到进程共享的 pzmq_reactor
      * 传入回调函数 raw_call 用于处理接收到的消息
-     * 使用 std::bind 绑定当前对象和回调函数
      */
     inline int creat_pull(const std::string &url, const msg_callback_fun &raw_call) {
         int ret = zmq_bind(zmq_socket_, url.c_str());
-        flage_ = false;
-        zmq_thread_ = std::make_unique<std::thread>(std::bind(&pzmq::zmq_event_loop, this, raw_call));
+        start_event_loop(raw_call);
 
         return ret;
     }
@@ -382,12 +566,11 @@ public:
         zmq_setsockopt(zmq_socket_, ZMQ_SUBSCRIBE, "", 0);
 
         /**
-         * 启动后台线程：
-         * 创建独立线程运行事件循环
+         * 启动接收：
+         * 独立线程运行事件循环，或者注册到 pzmq_reactor
          * 异步接收和处理发布者的消息
          */
-        flage_ = false;
-        zmq_thread_ = std::make_unique<std::thread>(std::bind(&pzmq::zmq_event_loop, this, raw_call));
+        start_event_loop(raw_call);
 
         return ret;
     }
@@ -397,14 +580,64 @@ public:
      */
     inline int creat_rep(const std::string &url, const msg_callback_fun &raw_call) {
         int ret = zmq_bind(zmq_socket_, url.c_str());
-        flage_ = false;
 
         /**
-         * 创建独立线程运行 zmq_event_loop 方法
+         * 创建独立线程运行 zmq_event_loop 方法，或者注册到 pzmq_reactor
          * 异步处理客户端的 RPC 请求
          * 传入回调函数处理具体的业务逻辑
          */
+        start_event_loop(raw_call);
+
+        return ret;
+    }
+
+    /**
+     * 启动 SUB/PULL/REP 套接字的接收：
+     * pzmq_reactor::enabled() 时把套接字注册到进程共享的反应器，回调在反应器的工作线程里执行，
+     * 不再为每个套接字起一个线程；否则和原来一样起 zmq_thread_ 运行 zmq_event_loop
+     */
+    void start_event_loop(const msg_callback_fun &raw_call) {
+        flage_ = false;
+        if (pzmq_reactor::enabled()) {
+            if (mode_ == ZMQ_RPC_FUN) {
+                reactor_id_ = pzmq_reactor::instance().add_rpc(
+                    zmq_socket_, std::bind(&pzmq::_rpc_dispatch, this, std::placeholders::_1, std::placeholders::_2));
+            } else {
+                reactor_id_ = pzmq_reactor::instance().add(
+                    zmq_socket_, [this, raw_call](const std::shared_ptr<pzmq_data> &msg) { raw_call(this, msg); });
+            }
+            return;
+        }
         zmq_thread_ = std::make_unique<std::thread>(std::bind(&pzmq::zmq_event_loop, this, raw_call));
+    }
+
+    /**
+     * 这个  creat_router 函数是多工作线程 RPC 服务端的创建方法：
+     * 1. 前端 ROUTER 套接字绑定服务地址，接收所有客户端的请求
+     * 2. 后端 ROUTER 套接字绑定进程内的 inproc 地址
+     * 3. 启动 rpc_workers_ 个工作线程，每个线程用自己的 REQ 套接字连接后端，先发送 "READY"
+     * 4. zmq_thread_ 运行 zmq_rpc_broker，只把请求交给空闲的工作线程
+     *
+     * 不直接用 zmq_proxy + DEALER 的原因：DEALER 按轮询分发，请求可能排到正在执行慢 action 的线程后面
+     * 请求和响应的对应关系由 ZMQ 信封（客户端身份帧 + 空帧）保证，工作线程回复时原样带回
+     */
+    inline int creat_router(const std::string &url) {
+        int ret = zmq_bind(zmq_socket_, url.c_str());
+        if (ret) {
+            return ret;
+        }
+        zmq_backend_ = zmq_socket(zmq_ctx_, ZMQ_ROUTER);
+        std::string backend_url = "inproc://pzmq.rpc." + std::to_string(reinterpret_cast<uintptr_t>(this));
+        ret = zmq_bind(zmq_backend_, backend_url.c_str());
+        if (ret) {
+            return ret;
+        }
+        flage_ = false;
+        for (int i = 0; i < rpc_workers_; ++i) {
+            zmq_workers_.push_back(
+                std::make_unique<std::thread>(std::bind(&pzmq::zmq_rpc_worker, this, backend_url)));
+        }
+        zmq_thread_ = std::make_unique<std::thread>(std::bind(&pzmq::zmq_rpc_broker, this));
 
         return ret;
     }
@@ -447,65 +680,199 @@ public:
         return zmq_connect(zmq_socket_, url.c_str());
     }
 
+    /**
+     * 查找并调用 action 对应的 RPC 函数：
+     * 只在查找时持有读锁，拷贝出回调后释放锁再调用，
+     * 用户回调执行期间不阻塞其它请求的分发，也不阻塞 register_rpc_action
+     */
+    std::string _rpc_dispatch(const std::shared_ptr<pzmq_data> &action, const std::shared_ptr<pzmq_data> &arg) {
+        rpc_callback_fun fun;
+        {
+            std::shared_lock<std::shared_mutex> lock(zmq_fun_mtx_);
+            auto iteam = zmq_fun_.find(action->string());
+            if (iteam == zmq_fun_.end()) {
+                return "NotAction";
+            }
+            fun = iteam->second;
+        }
+        try {
+            return fun(this, arg);
+        } catch (...) {
+            return "NotAction";
+        }
+    }
+
+    /**
+     * 把 from 上当前这条消息剩余的所有帧原样转发到 to
+     */
+    static void forward_frames(void *from, void *to) {
+        int more = 1;
+        size_t more_size = sizeof(more);
+        while (more) {
+            zmq_msg_t frame;
+            zmq_msg_init(&frame);
+            if (zmq_msg_recv(&frame, from, 0) < 0) {
+                zmq_msg_close(&frame);
+                return;
+            }
+            zmq_getsockopt(from, ZMQ_RCVMORE, &more, &more_size);
+            zmq_msg_send(&frame, to, more ? ZMQ_SNDMORE : 0);
+            zmq_msg_close(&frame);
+        }
+    }
+
+    /**
+     * 多工作线程模式的分发线程（负载均衡代理）：
+     * 后端消息格式：[worker_id][空帧]["READY"] 或 [worker_id][空帧][客户端信封...][空帧][响应]
+     * 前端消息格式：[客户端信封...][空帧][action][参数]
+     *
+     * 1. 后端可读：记录 worker_id 为空闲，如果不是 READY 就把剩余帧转发给前端
+     * 2. 前端可读（只有存在空闲工作线程时才轮询前端）：取出一个空闲工作线程，
+     *    加上 [worker_id][空帧] 后把整条请求转发给它
+     */
+    void zmq_rpc_broker() {
+        pthread_setname_np(pthread_self(), "zmq_rpc_broker");
+
+        std::deque<std::string> idle_workers;
+        while (!flage_.load()) {
+            zmq_pollitem_t items[3] = {{NULL, wake_fd_, ZMQ_POLLIN, 0},
+                                       {zmq_backend_, 0, ZMQ_POLLIN, 0},
+                                       {zmq_socket_, 0, ZMQ_POLLIN, 0}};
+            if (zmq_poll(items, idle_workers.empty() ? 2 : 3, -1) < 0) {
+                continue;
+            }
+            if (items[0].revents & ZMQ_POLLIN) {
+                break;
+            }
+            if (items[1].revents & ZMQ_POLLIN) {
+                pzmq_data worker_id, empty, head;
+                zmq_msg_recv(worker_id.get(), zmq_backend_, 0);
+                zmq_msg_recv(empty.get(), zmq_backend_, 0);
+                zmq_msg_recv(head.get(), zmq_backend_, 0);
+                idle_workers.push_back(worker_id.string());
+                if (zmq_msg_more(head.get())) {
+                    zmq_msg_send(head.get(), zmq_socket_, ZMQ_SNDMORE);
+                    forward_frames(zmq_backend_, zmq_socket_);
+                }
+            }
+            if ((items[2].revents & ZMQ_POLLIN) && (!idle_workers.empty())) {
+                std::string worker_id = idle_workers.front();
+                idle_workers.pop_front();
+                zmq_send(zmq_backend_, worker_id.c_str(), worker_id.length(), ZMQ_SNDMORE);
+                zmq_send(zmq_backend_, "", 0, ZMQ_SNDMORE);
+                forward_frames(zmq_socket_, zmq_backend_);
+            }
+        }
+    }
+
+    /**
+     * 多工作线程模式下每个工作线程的循环：
+     * 1. 用自己的 REQ 套接字连接后端，先发送 "READY" 表示空闲
+     * 2. 收到请求：空帧之前的都是客户端信封，之后是 [action][参数]
+     * 3. 分发后回复 [信封...][空帧][响应]，回复本身也表示重新空闲
+     */
+    void zmq_rpc_worker(const std::string &backend_url) {
+        pthread_setname_np(pthread_self(), "zmq_rpc_worker");
+
+        void *socket = zmq_socket(zmq_ctx_, ZMQ_REQ);
+        zmq_connect(socket, backend_url.c_str());
+        zmq_send(socket, "READY", 5, 0);
+        pzmq_data_pool data_pool;
+        std::vector<std::shared_ptr<pzmq_data>> envelope;
+        while (!flage_.load()) {
+            envelope.clear();
+            zmq_pollitem_t items[2] = {{NULL, wake_fd_, ZMQ_POLLIN, 0}, {socket, 0, ZMQ_POLLIN, 0}};
+            if (zmq_poll(items, 2, -1) < 0) {
+                continue;
+            }
+            if (items[0].revents & ZMQ_POLLIN) {
+                break;
+            }
+            bool recv_ok = true;
+            while (true) {
+                std::shared_ptr<pzmq_data> frame = data_pool.acquire();
+                if (zmq_msg_recv(frame->get(), socket, 0) < 0) {
+                    recv_ok = false;
+                    break;
+                }
+                if (frame->size() == 0) {
+                    break;
+                }
+                envelope.push_back(frame);
+            }
+            if (!recv_ok) {
+                continue;
+            }
+            std::shared_ptr<pzmq_data> action_ptr = data_pool.acquire();
+            std::shared_ptr<pzmq_data> arg_ptr = data_pool.acquire();
+            zmq_msg_recv(action_ptr->get(), socket, 0);
+            zmq_msg_recv(arg_ptr->get(), socket, 0);
+            std::string retval = _rpc_dispatch(action_ptr, arg_ptr);
+            for (auto &frame : envelope) {
+                zmq_msg_send(frame->get(), socket, ZMQ_SNDMORE);
+            }
+            zmq_send(socket, "", 0, ZMQ_SNDMORE);
+            zmq_send(socket, retval.c_str(), retval.length(), 0);
+            envelope.clear();
+        }
+        zmq_close(socket);
+    }
+
     /**
      * 这个  zmq_event_loop 函数是后台线程的事件循环，用于异步处理不同模式的消息：
      * 1. 设置线程名称为 "zmq_event_loop"，便于调试
-     * 2. 创建 zmq_pollitem_t 结构体数组 items，用于轮询
-     * 3. 如果是 PULL 模式，将套接字添加到轮询数组
-     * 4. 进入主循环，直到 flage_ 标志为 true
+     * 2. 同时轮询套接字和 wake_fd_，所有模式都先 zmq_poll 再接收；
+     *    上下文是进程共享的，不能再用 zmq_ctx_shutdown 打断阻塞的接收，析构时写 wake_fd_ 让循环退出
+     * 3. 进入主循环，直到 flage_ 标志为 true
+     * 4. 消息对象从 data_pool_ 中取，回调没有保存消息时对象会被复用，稳定状态下每条消息不再分配堆内存
      */
     void zmq_event_loop(const msg_callback_fun &raw_call) {
         pthread_setname_np(pthread_self(), "zmq_event_loop");
 
         int ret;
-        zmq_pollitem_t items[1];
-
-        // PULL 模式的轮询设置
-        if (mode_ == ZMQ_PULL) {
-            items[0].socket = zmq_socket_;
-            items[0].fd = 0;
-            items[0].events = ZMQ_POLLIN;
-            items[0].revents = 0;
-        }
+        zmq_pollitem_t items[2] = {{NULL, wake_fd_, ZMQ_POLLIN, 0}, {zmq_socket_, 0, ZMQ_POLLIN, 0}};
 
         // 循环条件：while (!flage_.load()) - 直到标志位为 true 才退出
         while (!flage_.load()) {
-            std::shared_ptr<pzmq_data> msg_ptr = std::make_shared<pzmq_data>();
-            if (mode_ == ZMQ_PULL) {
-                
-                ret = zmq_poll(items, 1, -1); // 无限等待消息
-                if (ret == -1) {
-                    zmq_close(zmq_socket_);
-                    continue;
-                }
-                if (!items[0].revents & ZMQ_POLLIN) {
-                    continue;
-                }
+            ret = zmq_poll(items, 2, -1); // 无限等待消息或唤醒
+            if (ret == -1) {
+                continue;
+            }
+            if (items[0].revents & ZMQ_POLLIN) {
+                break;
+            }
+            if (!(items[1].revents & ZMQ_POLLIN)) {
+                continue;
             }
 
             // 接收消息
+            std::shared_ptr<pzmq_data> msg_ptr = data_pool_.acquire();
             ret = zmq_msg_recv(msg_ptr->get(), zmq_socket_, 0);
             if (ret <= 0) {
                 msg_ptr.reset();
                 continue;
             }
 
+            // SUB/PULL 的多帧消息：把前面的帧挂到后一帧上，回调收到最后一帧
+            if ((mode_ != ZMQ_RPC_FUN) && zmq_msg_more(msg_ptr->get())) {
+                while (zmq_msg_more(msg_ptr->get())) {
+                    std::shared_ptr<pzmq_data> next_ptr = data_pool_.acquire();
+                    if (zmq_msg_recv(next_ptr->get(), zmq_socket_, 0) < 0) {
+                        break;
+                    }
+                    next_ptr->set_head(msg_ptr);
+                    msg_ptr = next_ptr;
+                }
+            }
+
             // RPC 模式特殊处理
             if (mode_ == ZMQ_RPC_FUN) {
-                std::shared_ptr<pzmq_data> msg1_ptr = std::make_shared<pzmq_data>();
+                std::shared_ptr<pzmq_data> msg1_ptr = data_pool_.acquire();
 
                 // 接收第二部分消息（参数）
                 zmq_msg_recv(msg1_ptr->get(), zmq_socket_, 0);
-                std::string retval;
-                try {
-                    std::unique_lock<std::mutex> lock(zmq_fun_mtx_);
-
-                    // 查找并调用对应的 RPC 函数
-                    retval = zmq_fun_.at(msg_ptr->string())(this, msg1_ptr);
-
-                } catch (...) {
-                    retval = "NotAction";
-                }
+                // 查找并调用对应的 RPC 函数
+                std::string retval = _rpc_dispatch(msg_ptr, msg1_ptr);
 
                 // 发送响应
                 zmq_send(zmq_socket_, retval.c_str(), retval.length(), 0);
@@ -519,7 +886,15 @@ public:
 
     void close_zmq() {
         zmq_close(zmq_socket_);
-        zmq_ctx_destroy(zmq_ctx_);
+        if (zmq_backend_) {
+            zmq_close(zmq_backend_);
+            zmq_backend_ = NULL;
+        }
+        if (wake_fd_ >= 0) {
+            close(wake_fd_);
+            wake_fd_ = -1;
+        }
+        pzmq_context::instance().release();
         if ((mode_ == ZMQ_PUB) || (mode_ == ZMQ_PULL) || (mode_ == ZMQ_RPC_FUN)) {
             if (!rpc_url_head_.empty()) {
                 std::string socket_file = zmq_url_.substr(rpc_url_head_length);
@@ -537,10 +912,22 @@ public:
             return ;
         }
         flage_ = true;
-        zmq_ctx_shutdown(zmq_ctx_);
+
+        // 写入后不读取，wake_fd_ 一直保持可读，事件循环、分发线程和所有工作线程都会被唤醒
+        uint64_t count = 1;
+        ssize_t ret = write(wake_fd_, &count, sizeof(count));
+        (void)ret;
+        if (reactor_id_ >= 0) {
+            pzmq_reactor::instance().remove(reactor_id_);
+            reactor_id_ = -1;
+        }
         if (zmq_thread_) {
             zmq_thread_->join();
         }
+        for (auto &worker : zmq_workers_) {
+            worker->join();
+        }
+        zmq_workers_.clear();
         close_zmq();
     }
 };
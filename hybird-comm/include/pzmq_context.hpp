@@ -0,0 +1,123 @@
+#pragma once
+
+#include <libzmq/zmq.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace StackFlows {
+
+/**
+ * pzmq_context 是进程级共享的 ZMQ 上下文：
+ *
+ * 背景：
+ * 每个 pzmq 对象在 creat 里都 zmq_ctx_new() 一次，一个单元有 N 个通道和订阅就有 N 个上下文，
+ * 每个上下文都有自己的 I/O 线程和内存池；不同上下文之间也不能使用 inproc:// 传输
+ *
+ * 设计：
+ * 1. 引用计数：第一个 acquire() 创建上下文，最后一个 release() 销毁，之后再 acquire() 会重新创建
+ * 2. 配置：set_io_threads()、set_max_sockets() 在上下文创建前调用才生效
+ *    （ZMQ_IO_THREADS 必须在创建第一个套接字之前设置），<= 0 表示使用 libzmq 默认值
+ * 3. 所有 pzmq 对象和 RPC 连接池共用这一个上下文，
+ *    同一进程内的模块之间可以直接用 inproc:// 通信
+ *
+ * 4. 嵌入模式：set_inproc(true) 后 pzmq 创建时把 ipc:// 地址改写成 inproc://（local_url()），
+ *    单元和 unit-manager 在同一个进程里时，消息在两个套接字之间只是交换指针，不经过内核
+ *    改写对整个进程生效，进程外的单元无法再连接，只用于全部单元都嵌入的部署
+ *
+ * 注意：共享上下文不能再用 zmq_ctx_shutdown 唤醒阻塞的事件循环，pzmq 改用 eventfd 唤醒
+ */
+class pzmq_context {
+private:
+    std::mutex ctx_mtx_;
+    void *zmq_ctx_;
+    int refs_;
+    int io_threads_;
+    int max_sockets_;
+    std::atomic<bool> inproc_;
+
+    pzmq_context() : zmq_ctx_(NULL), refs_(0), io_threads_(0), max_sockets_(0), inproc_(false) {
+    }
+
+public:
+    static pzmq_context &instance() {
+        static pzmq_context ctx;
+        return ctx;
+    }
+
+    pzmq_context(const pzmq_context &) = delete;
+    pzmq_context &operator=(const pzmq_context &) = delete;
+
+    void set_io_threads(int count) {
+        std::unique_lock<std::mutex> lock(ctx_mtx_);
+        io_threads_ = count;
+    }
+
+    void set_max_sockets(int count) {
+        std::unique_lock<std::mutex> lock(ctx_mtx_);
+        max_sockets_ = count;
+    }
+
+    // 嵌入模式开关，要在创建第一个 pzmq 对象之前设置
+    void set_inproc(bool enable) {
+        inproc_ = enable;
+    }
+
+    bool inproc() const {
+        return inproc_.load();
+    }
+
+    /**
+     * 嵌入模式下把 "ipc:///tmp/llm/5010.sock" 改写成 "inproc:///tmp/llm/5010.sock"，
+     * inproc 的地址只是一个名字，保留原来的路径就能保证同一个 ipc 地址两端改写的结果一致
+     * 非嵌入模式或者不是 ipc:// 地址时原样返回
+     */
+    std::string local_url(const std::string &url) const {
+        if ((!inproc_.load()) || (url.compare(0, 6, "ipc://") != 0)) {
+            return url;
+        }
+        return "inproc://" + url.substr(6);
+    }
+
+    void *acquire() {
+        std::unique_lock<std::mutex> lock(ctx_mtx_);
+        if (zmq_ctx_ == NULL) {
+            do {
+                zmq_ctx_ = zmq_ctx_new();
+            } while (zmq_ctx_ == NULL);
+            if (io_threads_ > 0) {
+                zmq_ctx_set(zmq_ctx_, ZMQ_IO_THREADS, io_threads_);
+            }
+            if (max_sockets_ > 0) {
+                zmq_ctx_set(zmq_ctx_, ZMQ_MAX_SOCKETS, max_sockets_);
+            }
+        }
+        refs_++;
+        return zmq_ctx_;
+    }
+
+    /**
+     * 归还引用，调用前必须已经关闭了在这个上下文上创建的所有套接字
+     * zmq_ctx_term 可能等待 linger，放在锁外执行
+     */
+    void release() {
+        void *ctx = NULL;
+        {
+            std::unique_lock<std::mutex> lock(ctx_mtx_);
+            if ((refs_ > 0) && (--refs_ == 0)) {
+                ctx = zmq_ctx_;
+                zmq_ctx_ = NULL;
+            }
+        }
+        if (ctx) {
+            zmq_ctx_term(ctx);
+        }
+    }
+
+    int refs() {
+        std::unique_lock<std::mutex> lock(ctx_mtx_);
+        return refs_;
+    }
+};
+
+} // namespace StackFlows
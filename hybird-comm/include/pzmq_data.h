@@ -1,7 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
+#include <string_view>
+#include <initializer_list>
 
 #include "zmq.h"
 
@@ -16,17 +21,52 @@ public:
     // Message access methods
     std::shared_ptr<std::string> get_string();
     std::string string();
+    std::string_view view();
     void *data();
     size_t size();
     zmq_msg_t *get();
+    void reset();
+
+    // 多帧消息：事件循环把前面的帧挂在最后一帧上，回调收到的是最后一帧（负载）
+    std::shared_ptr<pzmq_data> head();
+    void set_head(const std::shared_ptr<pzmq_data> &head);
 
     // Parameter handling methods
     std::string get_param(int index, const std::string& idata = "");
-    static std::string set_param(std::string parma0, std::string param1);
+    std::string_view get_param_view(int index);
+    int param_count();
+    static std::string_view param_view(std::string_view data, int index);
+    static std::string set_param(std::string_view param0, std::string_view param1);
+    static std::string set_params(std::initializer_list<std::string_view> params);
 
 private:
     zmq_msg_t msg;
+    std::shared_ptr<pzmq_data> head_;
+
+};
 
+/**
+ * pzmq_data_pool 是事件循环使用的 pzmq_data 回收池：
+ * 事件循环每收到一条消息都要 std::make_shared<pzmq_data>()，RPC 还要再分配一个参数帧
+ * 池里保存一组 shared_ptr，acquire() 时找一个只被池自己引用的（use_count() == 1）对象，
+ * reset() 后直接复用；回调如果把消息保存下来（如放进事件队列），引用计数大于 1，
+ * 这个对象就不会被复用，直到使用者释放
+ *
+ * 一个池只能在一个线程里 acquire()，统计数据可以在任意线程读取
+ */
+class pzmq_data_pool {
+public:
+    explicit pzmq_data_pool(size_t capacity = 16);
+    std::shared_ptr<pzmq_data> acquire();
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    std::vector<std::shared_ptr<pzmq_data>> slots_;
+    size_t capacity_;
+    size_t next_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
 };
 
 } // namespace StackFlows
\ No newline at end of file
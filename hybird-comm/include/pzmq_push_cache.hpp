@@ -0,0 +1,150 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pzmq.hpp"
+
+namespace StackFlows {
+
+/**
+ * pzmq_push_cache 是进程级的 PUSH 套接字缓存：
+ *
+ * 背景：
+ * StackFlow::send、zmq_com_send、llm_channel_obj::send_raw_for_url 每发送一条响应
+ * 都要 pzmq _zmq(url, ZMQ_PUSH)：新建上下文、connect、发送、销毁，错误/状态回复路径上
+ * 大部分 CPU 都花在套接字的创建和销毁上
+ *
+ * 设计：
+ * 1. 按 URL 缓存已经连接好的 PUSH 套接字，同一个 URL 的后续发送直接复用
+ * 2. LRU 淘汰：最多缓存 capacity_ 个 URL，超出时淘汰最久没用的
+ * 3. 空闲淘汰：超过 idle_timeout_ 没有发送过的 URL 在下一次访问缓存时被淘汰
+ * 4. 每个缓存项有自己的发送锁（ZMQ 套接字不是线程安全的），
+ *    被淘汰的缓存项在缓存锁之外销毁，正在使用它的线程用完后才真正关闭
+ * 5. erase() 在发送锁内把缓存项标记为 dead 并关闭套接字：已经取到这个缓存项的并发发送不会再重新创建套接字，
+ *    否则会留下一个连向已关闭会话端口的 PUSH，端口分给下一个会话后把旧响应发过去
+ */
+class pzmq_push_cache {
+private:
+    struct push_entry {
+        std::string url;
+        std::mutex send_mtx;
+        std::unique_ptr<pzmq> zmq;
+        bool dead = false; // erase() 之后置位，受 send_mtx 保护
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    std::mutex cache_mtx_;
+    std::list<std::shared_ptr<push_entry>> lru_;
+    std::unordered_map<std::string, std::list<std::shared_ptr<push_entry>>::iterator> index_;
+    size_t capacity_;
+    int idle_timeout_;
+    int linger_;
+
+    pzmq_push_cache() : capacity_(64), idle_timeout_(30000), linger_(1000) {
+    }
+
+    /**
+     * 取出 url 对应的缓存项并移到 LRU 头部，同时把需要淘汰的缓存项放进 evicted
+     */
+    std::shared_ptr<push_entry> get_entry(const std::string &url, std::vector<std::shared_ptr<push_entry>> &evicted) {
+        auto now = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(cache_mtx_);
+        std::shared_ptr<push_entry> entry;
+        auto iteam = index_.find(url);
+        if (iteam != index_.end()) {
+            entry = *iteam->second;
+            lru_.erase(iteam->second);
+        } else {
+            entry = std::make_shared<push_entry>();
+            entry->url = url;
+        }
+        entry->last_used = now;
+        lru_.push_front(entry);
+        index_[url] = lru_.begin();
+
+        while (lru_.size() > 1) {
+            auto &oldest = lru_.back();
+            auto idle_ms =
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - oldest->last_used).count();
+            if ((lru_.size() <= capacity_) && (idle_ms <= idle_timeout_)) {
+                break;
+            }
+            index_.erase(oldest->url);
+            evicted.push_back(oldest);
+            lru_.pop_back();
+        }
+        return entry;
+    }
+
+public:
+    static pzmq_push_cache &instance() {
+        static pzmq_push_cache cache;
+        return cache;
+    }
+
+    pzmq_push_cache(const pzmq_push_cache &) = delete;
+    pzmq_push_cache &operator=(const pzmq_push_cache &) = delete;
+
+    void set_capacity(size_t capacity) {
+        std::unique_lock<std::mutex> lock(cache_mtx_);
+        capacity_ = capacity;
+    }
+
+    void set_idle_timeout(int ms) {
+        std::unique_lock<std::mutex> lock(cache_mtx_);
+        idle_timeout_ = ms;
+    }
+
+    /**
+     * 通过缓存的 PUSH 套接字把 raw 发送到 url
+     * raw 可以是 const std::string&、移动进来的 std::string 或引用计数的数据块，
+     * 与 pzmq::send_data 的重载一致
+     */
+    template <typename T>
+    int send(const std::string &url, T &&raw) {
+        std::vector<std::shared_ptr<push_entry>> evicted;
+        std::shared_ptr<push_entry> entry = get_entry(url, evicted);
+        evicted.clear();
+
+        std::unique_lock<std::mutex> lock(entry->send_mtx);
+        if (entry->dead) {
+            return -1;
+        }
+        if (!entry->zmq) {
+            entry->zmq = std::make_unique<pzmq>(url, ZMQ_PUSH);
+
+            // 缓存项被淘汰时最多等待 linger_ ms 发送残留消息，避免对端消失时销毁阻塞
+            zmq_setsockopt(entry->zmq->zmq_socket_, ZMQ_LINGER, &linger_, sizeof(linger_));
+        }
+        return entry->zmq->send_data(std::forward<T>(raw));
+    }
+
+    /**
+     * 对端（如 TCP 会话的 PULL）已经关闭时主动移除对应的缓存项
+     */
+    void erase(const std::string &url) {
+        std::shared_ptr<push_entry> entry;
+        std::unique_lock<std::mutex> lock(cache_mtx_);
+        auto iteam = index_.find(url);
+        if (iteam == index_.end()) {
+            return;
+        }
+        entry = *iteam->second;
+        lru_.erase(iteam->second);
+        index_.erase(iteam);
+        lock.unlock();
+
+        std::unique_lock<std::mutex> send_lock(entry->send_mtx);
+        entry->dead = true;
+        entry->zmq.reset();
+    }
+};
+
+} // namespace StackFlows
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <libzmq/zmq.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pzmq_data.h"
+
+namespace StackFlows {
+
+/**
+ * pzmq_reactor 是进程级的 ZMQ 接收反应器：
+ *
+ * 背景：
+ * SUB/PULL/REP 模式的 pzmq 每个都起一个 zmq_thread_ 跑 zmq_event_loop，
+ * 一个单元订阅几个上游 work_id 再加上自己的 RPC 服务，就有一堆大部分时间都在空等的线程
+ *
+ * 设计：
+ * 1. 一个轮询线程：所有注册的套接字放进同一个 zmq_poll，收到的消息（含多帧）挂到对应源的队列上
+ * 2. 一组工作线程：执行用户回调，线程数和订阅数量无关，默认等于 CPU 核数
+ * 3. 每个源串行：同一个套接字的消息按接收顺序、同一时刻只在一个工作线程里执行（类似 strand），
+ *    和原来单线程事件循环的语义一致；不同的源可以并行
+ * 4. REP 源：轮询线程收到 [action][参数] 后暂停轮询这个套接字，工作线程算出响应后交回轮询线程发送，
+ *    套接字始终只在轮询线程里收发
+ * 5. 背压：一个源积压超过 max_pending 条时暂停轮询它，消息留在 ZMQ 的接收队列里，由 HWM 限流
+ *
+ * 套接字的创建和关闭仍然由 pzmq 负责：add() 之后套接字归轮询线程使用，
+ * remove() 返回时轮询线程不再碰这个套接字，并且这个源没有正在执行的回调，之后才可以 zmq_close
+ *
+ * 开关：set_enabled(true) 之后创建的 pzmq 才会注册到反应器，set_workers() 要在第一次注册前调用
+ */
+class pzmq_reactor {
+public:
+    using msg_fun = std::function<void(const std::shared_ptr<pzmq_data> &)>;
+    using rpc_fun = std::function<std::string(const std::shared_ptr<pzmq_data> &, const std::shared_ptr<pzmq_data> &)>;
+
+    static constexpr size_t max_pending = 1024;
+    static constexpr size_t batch_size = 32;
+
+private:
+    struct source {
+        int id;
+        void *socket;
+        msg_fun on_msg;
+        rpc_fun on_rpc;
+        std::mutex mtx;
+        std::condition_variable idle_cv;
+        std::deque<std::pair<std::shared_ptr<pzmq_data>, std::shared_ptr<pzmq_data>>> pending;
+        bool scheduled; // 在就绪队列里或者正在被工作线程执行
+        bool closed;
+        bool busy;                  // REP 源等待响应，只在轮询线程里访问
+        std::atomic<bool> throttled; // 积压过多，暂停轮询
+    };
+
+    struct command {
+        std::shared_ptr<source> add;
+        int remove;
+        std::shared_ptr<std::promise<std::shared_ptr<source>>> done;
+    };
+
+    int wake_fd_;
+    std::atomic<bool> exit_flage_;
+    std::atomic<bool> resume_;
+    std::mutex cmd_mtx_;
+    std::deque<command> commands_;
+    std::deque<std::pair<std::shared_ptr<source>, std::string>> replies_;
+    std::mutex ready_mtx_;
+    std::condition_variable ready_cv_;
+    std::deque<std::shared_ptr<source>> ready_;
+    std::atomic<int> next_id_;
+    std::atomic<uint64_t> dispatched_;
+    std::atomic<size_t> sources_;
+    int workers_count_;
+    pzmq_data_pool data_pool_; // 轮询线程专用的消息对象池，命中统计可在任意线程读取
+    std::unique_ptr<std::thread> poll_thread_;
+    std::vector<std::unique_ptr<std::thread>> workers_;
+    std::once_flag start_flag_;
+
+    static std::atomic<bool> &enabled_flag() {
+        static std::atomic<bool> enabled(false);
+        return enabled;
+    }
+
+    static source *&current_source() {
+        static thread_local source *current = NULL;
+        return current;
+    }
+
+    pzmq_reactor() : exit_flage_(false), resume_(false), next_id_(1), dispatched_(0), sources_(0), workers_count_(0),
+                     data_pool_(64) {
+        wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+
+    void wakeup() {
+        uint64_t count = 1;
+        ssize_t ret = write(wake_fd_, &count, sizeof(count));
+        (void)ret;
+    }
+
+    void start() {
+        std::call_once(start_flag_, [this]() {
+            int count = workers_count_;
+            if (count <= 0) {
+                count = std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+            }
+            for (int i = 0; i < count; ++i) {
+                workers_.push_back(std::make_unique<std::thread>(std::bind(&pzmq_reactor::worker_loop, this)));
+            }
+            poll_thread_ = std::make_unique<std::thread>(std::bind(&pzmq_reactor::poll_loop, this));
+        });
+    }
+
+    int post_add(void *socket, msg_fun on_msg, rpc_fun on_rpc) {
+        start();
+        auto src = std::make_shared<source>();
+        src->id = next_id_++;
+        src->socket = socket;
+        src->on_msg = std::move(on_msg);
+        src->on_rpc = std::move(on_rpc);
+        src->scheduled = false;
+        src->closed = false;
+        src->busy = false;
+        src->throttled = false;
+        {
+            std::unique_lock<std::mutex> lock(cmd_mtx_);
+            commands_.push_back({src, -1, nullptr});
+        }
+        wakeup();
+
+        return src->id;
+    }
+
+    // 把源放进就绪队列，调用前必须持有 src->mtx
+    void schedule(const std::shared_ptr<source> &src) {
+        if (src->scheduled) {
+            return;
+        }
+        src->scheduled = true;
+        {
+            std::unique_lock<std::mutex> lock(ready_mtx_);
+            ready_.push_back(src);
+        }
+        ready_cv_.notify_one();
+    }
+
+    /**
+     * 从套接字上接收一条完整的消息，多帧消息的前面几帧挂在最后一帧上，与 pzmq::zmq_event_loop 一致
+     * REP 源接收 [action][参数] 两帧
+     *
+     * 这里在唯一的轮询线程上执行，不能阻塞：ZMQ 的多帧消息是整条到达的，先确认还有下一帧再接收；
+     * 缺少参数帧的畸形请求直接回复 "NotAction"（REP 必须先回复才能收下一条），多出来的帧丢弃
+     * 返回 true 表示收到了一条消息并交给了工作线程，REP 源在响应发出前不再轮询
+     */
+    bool recv_one(const std::shared_ptr<source> &src, pzmq_data_pool &data_pool) {
+        std::shared_ptr<pzmq_data> msg_ptr = data_pool.acquire();
+        if (zmq_msg_recv(msg_ptr->get(), src->socket, ZMQ_DONTWAIT) < 0) {
+            return false;
+        }
+        std::shared_ptr<pzmq_data> arg_ptr;
+        if (src->on_rpc) {
+            if (!zmq_msg_more(msg_ptr->get())) {
+                zmq_send(src->socket, "NotAction", 9, 0);
+                return false;
+            }
+            arg_ptr = data_pool.acquire();
+            if (zmq_msg_recv(arg_ptr->get(), src->socket, ZMQ_DONTWAIT) < 0) {
+                zmq_send(src->socket, "NotAction", 9, 0);
+                return false;
+            }
+            bool more = zmq_msg_more(arg_ptr->get());
+            while (more) {
+                pzmq_data extra;
+                if (zmq_msg_recv(extra.get(), src->socket, ZMQ_DONTWAIT) < 0) {
+                    break;
+                }
+                more = zmq_msg_more(extra.get());
+            }
+        } else {
+            while (zmq_msg_more(msg_ptr->get())) {
+                std::shared_ptr<pzmq_data> next_ptr = data_pool.acquire();
+                if (zmq_msg_recv(next_ptr->get(), src->socket, 0) < 0) {
+                    break;
+                }
+                next_ptr->set_head(msg_ptr);
+                msg_ptr = next_ptr;
+            }
+        }
+        std::unique_lock<std::mutex> lock(src->mtx);
+        src->pending.emplace_back(std::move(msg_ptr), std::move(arg_ptr));
+        if (src->pending.size() >= max_pending) {
+            src->throttled = true;
+        }
+        schedule(src);
+
+        return true;
+    }
+
+    /**
+     * 轮询线程：
+     * items[0] 是 wake_fd_，有命令（注册、注销）、REP 响应或者背压解除时被唤醒
+     * 轮询集合只在源变化时重建；处理完命令后直接进入下一轮，已注销的套接字不会再被访问
+     */
+    void poll_loop() {
+        pthread_setname_np(pthread_self(), "zmq_reactor");
+
+        std::unordered_map<int, std::shared_ptr<source>> sources;
+        std::vector<zmq_pollitem_t> items;
+        std::vector<std::shared_ptr<source>> polled;
+        bool dirty = true;
+        while (!exit_flage_.load()) {
+            if (dirty) {
+                items.clear();
+                polled.clear();
+                items.push_back({NULL, wake_fd_, ZMQ_POLLIN, 0});
+                for (auto &iteam : sources) {
+                    if (iteam.second->busy || iteam.second->throttled.load()) {
+                        continue;
+                    }
+                    items.push_back({iteam.second->socket, 0, ZMQ_POLLIN, 0});
+                    polled.push_back(iteam.second);
+                }
+                dirty = false;
+            }
+            if (zmq_poll(items.data(), static_cast<int>(items.size()), -1) < 0) {
+                continue;
+            }
+            if (items[0].revents & ZMQ_POLLIN) {
+                uint64_t count;
+                ssize_t ret = read(wake_fd_, &count, sizeof(count));
+                (void)ret;
+                std::deque<command> commands;
+                std::deque<std::pair<std::shared_ptr<source>, std::string>> replies;
+                {
+                    std::unique_lock<std::mutex> lock(cmd_mtx_);
+                    commands.swap(commands_);
+                    replies.swap(replies_);
+                }
+                for (auto &reply : replies) {
+                    if (sources.find(reply.first->id) == sources.end()) {
+                        continue;
+                    }
+                    zmq_send(reply.first->socket, reply.second.c_str(), reply.second.length(), 0);
+                    reply.first->busy = false;
+                    dirty = true;
+                }
+                for (auto &cmd : commands) {
+                    if (cmd.add) {
+                        sources[cmd.add->id] = cmd.add;
+                        sources_++;
+                    } else {
+                        std::shared_ptr<source> removed;
+                        auto iteam = sources.find(cmd.remove);
+                        if (iteam != sources.end()) {
+                            removed = iteam->second;
+                            {
+                                std::unique_lock<std::mutex> lock(iteam->second->mtx);
+                                iteam->second->closed = true;
+                                iteam->second->pending.clear();
+                            }
+                            sources.erase(iteam);
+                            sources_--;
+                        }
+                        if (cmd.done) {
+                            cmd.done->set_value(removed);
+                        }
+                    }
+                    dirty = true;
+                }
+                if (resume_.exchange(false)) {
+                    dirty = true;
+                }
+                if (dirty) {
+                    continue;
+                }
+            }
+            for (size_t i = 1; i < items.size(); ++i) {
+                if (!(items[i].revents & ZMQ_POLLIN)) {
+                    continue;
+                }
+                const std::shared_ptr<source> &src = polled[i - 1];
+                if (src->on_rpc) {
+                    // REP 一次只能有一个请求，等响应发出后再轮询
+                    if (recv_one(src, data_pool_)) {
+                        src->busy = true;
+                        dirty = true;
+                    }
+                    continue;
+                }
+                for (size_t n = 0; n < batch_size; ++n) {
+                    if (!recv_one(src, data_pool_)) {
+                        break;
+                    }
+                    if (src->throttled.load()) {
+                        dirty = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * 工作线程：从就绪队列取一个源，最多连续执行 batch_size 条消息，
+     * 还有剩余就放回队尾，避免一个高频的源占住工作线程
+     */
+    void worker_loop() {
+        pthread_setname_np(pthread_self(), "zmq_reactor_w");
+
+        while (true) {
+            std::shared_ptr<source> src;
+            {
+                std::unique_lock<std::mutex> lock(ready_mtx_);
+                ready_cv_.wait(lock, [this]() { return exit_flage_.load() || !ready_.empty(); });
+                if (exit_flage_.load()) {
+                    break;
+                }
+                src = ready_.front();
+                ready_.pop_front();
+            }
+            current_source() = src.get();
+            for (size_t n = 0; n < batch_size; ++n) {
+                std::pair<std::shared_ptr<pzmq_data>, std::shared_ptr<pzmq_data>> msg;
+                {
+                    std::unique_lock<std::mutex> lock(src->mtx);
+                    if (src->closed || src->pending.empty()) {
+                        break;
+                    }
+                    msg = std::move(src->pending.front());
+                    src->pending.pop_front();
+                }
+                if (src->on_rpc) {
+                    std::string retval = src->on_rpc(msg.first, msg.second);
+                    {
+                        std::unique_lock<std::mutex> lock(cmd_mtx_);
+                        replies_.emplace_back(src, std::move(retval));
+                    }
+                    wakeup();
+                } else {
+                    src->on_msg(msg.first);
+                }
+                dispatched_++;
+            }
+            current_source() = NULL;
+
+            std::unique_lock<std::mutex> lock(src->mtx);
+            if ((!src->closed) && src->throttled.load() && (src->pending.size() < max_pending / 2)) {
+                src->throttled = false;
+                resume_ = true;
+                wakeup();
+            }
+            src->scheduled = false;
+            if ((!src->closed) && (!src->pending.empty())) {
+                schedule(src);
+            } else {
+                src->idle_cv.notify_all();
+            }
+        }
+    }
+
+public:
+    static pzmq_reactor &instance() {
+        static pzmq_reactor reactor;
+        return reactor;
+    }
+
+    pzmq_reactor(const pzmq_reactor &) = delete;
+    pzmq_reactor &operator=(const pzmq_reactor &) = delete;
+
+    static void set_enabled(bool enabled) {
+        enabled_flag() = enabled;
+    }
+
+    static bool enabled() {
+        return enabled_flag().load();
+    }
+
+    // 工作线程数，<= 0 表示 CPU 核数（至少 2 个），只在第一次注册前设置有效
+    void set_workers(int count) {
+        workers_count_ = count;
+    }
+
+    // 注册 SUB/PULL 套接字，回调在工作线程中执行，返回源 ID
+    int add(void *socket, msg_fun on_msg) {
+        return post_add(socket, std::move(on_msg), nullptr);
+    }
+
+    // 注册 REP 套接字，回调的返回值作为响应发回
+    int add_rpc(void *socket, rpc_fun on_rpc) {
+        return post_add(socket, nullptr, std::move(on_rpc));
+    }
+
+    /**
+     * 注销源：等轮询线程把套接字移出轮询集合，再等这个源正在执行的回调结束
+     * 在这个源自己的回调里注销时不等待回调结束（否则会等自己），剩余的消息被丢弃
+     */
+    void remove(int id) {
+        if (exit_flage_.load() || (!poll_thread_)) {
+            return;
+        }
+        auto done = std::make_shared<std::promise<std::shared_ptr<source>>>();
+        std::future<std::shared_ptr<source>> wait_done = done->get_future();
+        {
+            std::unique_lock<std::mutex> lock(cmd_mtx_);
+            commands_.push_back({nullptr, id, done});
+        }
+        wakeup();
+        std::shared_ptr<source> src = wait_done.get();
+        if (src && (src.get() != current_source())) {
+            std::unique_lock<std::mutex> lock(src->mtx);
+            src->idle_cv.wait(lock, [&src]() { return !src->scheduled; });
+        }
+    }
+
+    size_t sources() const {
+        return sources_.load();
+    }
+
+    uint64_t dispatched() const {
+        return dispatched_.load();
+    }
+
+    // 轮询线程消息对象池的命中和未命中次数
+    uint64_t pool_hits() const {
+        return data_pool_.hits();
+    }
+
+    uint64_t pool_misses() const {
+        return data_pool_.misses();
+    }
+
+    ~pzmq_reactor() {
+        exit_flage_ = true;
+        wakeup();
+        ready_cv_.notify_all();
+        if (poll_thread_) {
+            poll_thread_->join();
+        }
+        for (auto &worker : workers_) {
+            worker->join();
+        }
+        close(wake_fd_);
+    }
+};
+
+} // namespace StackFlows
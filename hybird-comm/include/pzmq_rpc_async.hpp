@@ -0,0 +1,234 @@
+#pragma once
+
+#include <libzmq/zmq.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "pzmq_data.h"
+#include "pzmq_rpc_pool.hpp"
+
+namespace StackFlows {
+
+/**
+ * pzmq_rpc_async 是异步、可流水线的 RPC 客户端：
+ *
+ * 背景：
+ * call_rpc_action 是严格的 REQ/REP，一个套接字同一时刻只能有一个未完成的请求，
+ * 调用者要阻塞到响应返回（最多 timeout_ ms），多个 RPC 只能一个一个排队
+ *
+ * 设计：
+ * 1. 每个服务 URL 一个 DEALER 连接，所有请求复用这一个连接，可以同时有很多个请求在途
+ * 2. 每个请求带一个 8 字节的请求 ID：[请求ID][空帧][action][参数]
+ *    REP（以及多工作线程模式的 ROUTER）会把空帧之前的信封原样带回：[请求ID][空帧][响应]
+ *    根据请求 ID 找到对应的回调，请求和响应的对应关系不依赖顺序
+ * 3. DEALER 套接字只在 io 线程里使用，调用者把请求放进队列后通过 eventfd 唤醒 io 线程发送
+ * 4. io 线程同时负责超时检查，超时的请求以 -1 回调
+ *
+ * 注意：回调在 io 线程中执行，不要在回调里做耗时操作；在回调里再发起异步调用是安全的
+ */
+class pzmq_rpc_async {
+public:
+    using async_callback = std::function<void(int, const std::shared_ptr<pzmq_data> &)>;
+
+private:
+    struct rpc_request {
+        uint64_t id;
+        std::string action;
+        std::string data;
+        int timeout;
+        async_callback callback;
+    };
+
+    struct rpc_pending {
+        async_callback callback;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    std::string url_;
+    void *zmq_socket_;
+    int wake_fd_;
+    std::mutex queue_mtx_;
+    std::deque<rpc_request> send_queue_;
+    std::unordered_map<uint64_t, rpc_pending> pending_;
+    std::atomic<uint64_t> next_id_;
+    std::atomic<bool> exit_flage_;
+    std::unique_ptr<std::thread> io_thread_;
+
+    void send_request(rpc_request &request) {
+        int ret = zmq_send(zmq_socket_, &request.id, sizeof(request.id), ZMQ_SNDMORE | ZMQ_DONTWAIT);
+        if (ret >= 0) {
+            zmq_send(zmq_socket_, "", 0, ZMQ_SNDMORE);
+            zmq_send(zmq_socket_, request.action.c_str(), request.action.length(), ZMQ_SNDMORE);
+            ret = zmq_send(zmq_socket_, request.data.c_str(), request.data.length(), 0);
+        }
+        if (ret < 0) {
+            request.callback(-1, nullptr);
+            return;
+        }
+        pending_[request.id] = rpc_pending{std::move(request.callback),
+                                           std::chrono::steady_clock::now() +
+                                               std::chrono::milliseconds(request.timeout)};
+    }
+
+    /**
+     * 接收一条响应：[请求ID][空帧][响应]
+     * 找不到请求 ID（已经超时）的响应直接丢弃
+     */
+    void recv_reply() {
+        pzmq_data id_frame;
+        if (zmq_msg_recv(id_frame.get(), zmq_socket_, ZMQ_DONTWAIT) < 0) {
+            return;
+        }
+        uint64_t id = 0;
+        bool valid = (id_frame.size() == sizeof(id)) && zmq_msg_more(id_frame.get());
+        if (valid) {
+            memcpy(&id, id_frame.data(), sizeof(id));
+        }
+        std::shared_ptr<pzmq_data> reply;
+        int more = zmq_msg_more(id_frame.get());
+        while (more) {
+            std::shared_ptr<pzmq_data> frame = std::make_shared<pzmq_data>();
+            zmq_msg_recv(frame->get(), zmq_socket_, 0);
+            more = zmq_msg_more(frame->get());
+            reply = frame;
+        }
+        if (!valid) {
+            return;
+        }
+        auto iteam = pending_.find(id);
+        if (iteam == pending_.end()) {
+            return;
+        }
+        async_callback callback = std::move(iteam->second.callback);
+        pending_.erase(iteam);
+        callback(0, reply);
+    }
+
+    /**
+     * 检查超时请求，返回距离最近一个截止时间的毫秒数（作为下次 zmq_poll 的超时）
+     */
+    long check_timeout() {
+        auto now = std::chrono::steady_clock::now();
+        long next_timeout = 1000;
+        for (auto iteam = pending_.begin(); iteam != pending_.end();) {
+            if (iteam->second.deadline <= now) {
+                async_callback callback = std::move(iteam->second.callback);
+                iteam = pending_.erase(iteam);
+                callback(-1, nullptr);
+                continue;
+            }
+            long left =
+                std::chrono::duration_cast<std::chrono::milliseconds>(iteam->second.deadline - now).count() + 1;
+            if (left < next_timeout) {
+                next_timeout = left;
+            }
+            ++iteam;
+        }
+        return next_timeout;
+    }
+
+    void io_loop() {
+        pthread_setname_np(pthread_self(), "zmq_rpc_async");
+
+        long timeout = 1000;
+        while (!exit_flage_.load()) {
+            zmq_pollitem_t items[2] = {{zmq_socket_, 0, ZMQ_POLLIN, 0}, {NULL, wake_fd_, ZMQ_POLLIN, 0}};
+            zmq_poll(items, 2, timeout);
+            if (items[1].revents & ZMQ_POLLIN) {
+                uint64_t count;
+                ssize_t ret = read(wake_fd_, &count, sizeof(count));
+                (void)ret;
+                std::deque<rpc_request> requests;
+                {
+                    std::unique_lock<std::mutex> lock(queue_mtx_);
+                    requests.swap(send_queue_);
+                }
+                for (auto &request : requests) {
+                    send_request(request);
+                }
+            }
+            if (items[0].revents & ZMQ_POLLIN) {
+                int events = 0;
+                size_t events_size = sizeof(events);
+                do {
+                    recv_reply();
+                    zmq_getsockopt(zmq_socket_, ZMQ_EVENTS, &events, &events_size);
+                } while (events & ZMQ_POLLIN);
+            }
+            timeout = check_timeout();
+        }
+    }
+
+public:
+    pzmq_rpc_async(void *zmq_ctx, const std::string &url) : url_(url), next_id_(1), exit_flage_(false) {
+        zmq_socket_ = zmq_socket(zmq_ctx, ZMQ_DEALER);
+        int linger = 0;
+        zmq_setsockopt(zmq_socket_, ZMQ_LINGER, &linger, sizeof(linger));
+        int reconnect_interval = 100;
+        zmq_setsockopt(zmq_socket_, ZMQ_RECONNECT_IVL, &reconnect_interval, sizeof(reconnect_interval));
+        zmq_connect(zmq_socket_, url_.c_str());
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        io_thread_ = std::make_unique<std::thread>(std::bind(&pzmq_rpc_async::io_loop, this));
+    }
+
+    /**
+     * 获取 url 对应的进程级异步客户端，第一次使用时创建
+     */
+    static std::shared_ptr<pzmq_rpc_async> instance(const std::string &url) {
+        void *zmq_ctx = pzmq_rpc_pool::instance().context();
+        static std::mutex clients_mtx;
+        static std::unordered_map<std::string, std::shared_ptr<pzmq_rpc_async>> clients;
+        std::unique_lock<std::mutex> lock(clients_mtx);
+        auto &client = clients[url];
+        if (!client) {
+            client = std::make_shared<pzmq_rpc_async>(zmq_ctx, url);
+        }
+        return client;
+    }
+
+    pzmq_rpc_async(const pzmq_rpc_async &) = delete;
+    pzmq_rpc_async &operator=(const pzmq_rpc_async &) = delete;
+
+    /**
+     * 发起一次异步调用，立即返回
+     * callback(ret, data)：ret 为 0 表示成功，data 是服务端的响应；-1 表示发送失败或超时
+     */
+    void call(const std::string &action, const std::string &data, int timeout, const async_callback &callback) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            send_queue_.push_back(rpc_request{next_id_++, action, data, timeout, callback});
+        }
+        uint64_t count = 1;
+        ssize_t ret = write(wake_fd_, &count, sizeof(count));
+        (void)ret;
+    }
+
+    ~pzmq_rpc_async() {
+        exit_flage_ = true;
+        uint64_t count = 1;
+        ssize_t ret = write(wake_fd_, &count, sizeof(count));
+        (void)ret;
+        io_thread_->join();
+        for (auto &iteam : pending_) {
+            iteam.second.callback(-1, nullptr);
+        }
+        for (auto &request : send_queue_) {
+            request.callback(-1, nullptr);
+        }
+        zmq_close(zmq_socket_);
+        close(wake_fd_);
+    }
+};
+
+} // namespace StackFlows
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <libzmq/zmq.h>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unistd.h>
+
+#include "pzmq_context.hpp"
+
+namespace StackFlows {
+
+/**
+ * pzmq_rpc_pool 是进程级的 RPC 客户端连接池：
+ *
+ * 背景：
+ * 原来的 call_rpc_action 每次调用都会 zmq_ctx_new() + 创建 REQ 套接字 + connect，
+ * 调用结束后再 close_zmq() 销毁，unit_call("sys", ...) 每次都要付出上下文创建、
+ * IPC 连接和销毁的代价
+ *
+ * 设计：
+ * 1. 共享上下文：池化套接字挂在进程共享的 pzmq_context 上，和其它 pzmq 对象共用一个上下文
+ * 2. 按服务 URL 分组：每个 RPC 服务（如 ipc:///tmp/rpc.sys）维护一组空闲的 REQ 套接字
+ * 3. 借出/归还：acquire() 借出一个已连接的套接字，用完 release() 归还，
+ *    同一时刻一个套接字只被一个调用者使用（ZMQ 套接字本身不是线程安全的）
+ *
+ * 健康检查与重连：
+ * 1. IPC 服务的套接字文件不存在时，说明服务已经退出，丢弃该服务的所有空闲连接
+ * 2. 空闲超过 idle_timeout_ 的连接直接关闭，重新建立连接
+ * 3. 调用失败（发送失败/接收超时）的 REQ 套接字状态机已经错乱，归还时直接关闭，
+ *    下次 acquire() 会重新创建连接
+ */
+class pzmq_rpc_pool {
+private:
+    struct rpc_conn {
+        void *socket;
+        int timeout;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    void *zmq_ctx_;
+    std::mutex pool_mtx_;
+    std::unordered_map<std::string, std::list<rpc_conn>> idle_conn_;
+    size_t max_idle_;
+    int idle_timeout_;
+
+    pzmq_rpc_pool() : max_idle_(8), idle_timeout_(30000) {
+        zmq_ctx_ = pzmq_context::instance().acquire();
+    }
+
+    void *creat_conn(const std::string &url, int timeout) {
+        void *socket = zmq_socket(zmq_ctx_, ZMQ_REQ);
+        if (socket == NULL) {
+            return NULL;
+        }
+
+        // 关闭套接字时不等待未发送的消息，避免丢弃坏连接时阻塞
+        int linger = 0;
+        zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+        zmq_setsockopt(socket, ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
+        zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+        if (zmq_connect(socket, url.c_str()) != 0) {
+            zmq_close(socket);
+            return NULL;
+        }
+        return socket;
+    }
+
+public:
+    static pzmq_rpc_pool &instance() {
+        static pzmq_rpc_pool pool;
+        return pool;
+    }
+
+    pzmq_rpc_pool(const pzmq_rpc_pool &) = delete;
+    pzmq_rpc_pool &operator=(const pzmq_rpc_pool &) = delete;
+
+    void *context() {
+        return zmq_ctx_;
+    }
+
+    void set_max_idle(size_t count) {
+        std::unique_lock<std::mutex> lock(pool_mtx_);
+        max_idle_ = count;
+    }
+
+    void set_idle_timeout(int ms) {
+        std::unique_lock<std::mutex> lock(pool_mtx_);
+        idle_timeout_ = ms;
+    }
+
+    /**
+     * 借出一个连接到 url 的 REQ 套接字：
+     * socket_file：IPC 服务对应的套接字文件，为空表示不做文件存在性检查（tcp 等）
+     * timeout：发送/接收超时时间（ms），与连接缓存的值不同时重新设置
+     *
+     * 返回 NULL 表示服务不可用或创建套接字失败
+     */
+    void *acquire(const std::string &url, const std::string &socket_file, int timeout) {
+        if ((!socket_file.empty()) && (access(socket_file.c_str(), F_OK) != 0)) {
+            drop(url);
+            return NULL;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(pool_mtx_);
+            auto &conns = idle_conn_[url];
+            while (!conns.empty()) {
+                rpc_conn conn = conns.front();
+                conns.pop_front();
+                auto idle_ms =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(now - conn.last_used).count();
+                if (idle_ms > idle_timeout_) {
+                    zmq_close(conn.socket);
+                    continue;
+                }
+                if (conn.timeout != timeout) {
+                    zmq_setsockopt(conn.socket, ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
+                    zmq_setsockopt(conn.socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+                }
+                return conn.socket;
+            }
+        }
+        return creat_conn(url, timeout);
+    }
+
+    /**
+     * 归还套接字：
+     * healthy 为 false 时（调用失败）直接关闭，否则放回空闲队列头部，
+     * 优先复用最近使用过的连接，超出 max_idle_ 的部分关闭
+     */
+    void release(const std::string &url, void *socket, int timeout, bool healthy) {
+        if (socket == NULL) {
+            return;
+        }
+        if (healthy) {
+            std::unique_lock<std::mutex> lock(pool_mtx_);
+            auto &conns = idle_conn_[url];
+            if (conns.size() < max_idle_) {
+                conns.push_front(rpc_conn{socket, timeout, std::chrono::steady_clock::now()});
+                return;
+            }
+        }
+        zmq_close(socket);
+    }
+
+    void drop(const std::string &url) {
+        std::unique_lock<std::mutex> lock(pool_mtx_);
+        auto iteam = idle_conn_.find(url);
+        if (iteam == idle_conn_.end()) {
+            return;
+        }
+        for (auto &conn : iteam->second) {
+            zmq_close(conn.socket);
+        }
+        idle_conn_.erase(iteam);
+    }
+
+    ~pzmq_rpc_pool() {
+        {
+            std::unique_lock<std::mutex> lock(pool_mtx_);
+            for (auto &iteam : idle_conn_) {
+                for (auto &conn : iteam.second) {
+                    zmq_close(conn.socket);
+                }
+            }
+            idle_conn_.clear();
+        }
+        pzmq_context::instance().release();
+    }
+};
+
+} // namespace StackFlows
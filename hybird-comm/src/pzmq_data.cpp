@@ -22,6 +22,35 @@ std::string pzmq_data::string() {
     return std::string((const char *)zmq_msg_data(&msg), len);
 }
 
+/**
+ * 释放消息内容并重新初始化为空消息，供 pzmq_data_pool 复用对象
+ */
+void pzmq_data::reset() {
+    zmq_msg_close(&msg);
+    zmq_msg_init(&msg);
+    head_.reset();
+}
+
+/**
+ * 多帧消息的前一帧，例如 unit-manager 转发 inference 请求时的路由帧 [zmq_com][原始请求]
+ * 单帧消息返回 nullptr
+ */
+std::shared_ptr<pzmq_data> pzmq_data::head() {
+    return head_;
+}
+
+void pzmq_data::set_head(const std::shared_ptr<pzmq_data> &head) {
+    head_ = head;
+}
+
+/**
+ * 不拷贝地访问消息内容，返回的 string_view 直接指向 zmq_msg_t 的数据，
+ * 在本 pzmq_data 对象存活期间有效；需要长期保存时再用 string() 拷贝
+ */
+std::string_view pzmq_data::view() {
+    return std::string_view(static_cast<const char *>(zmq_msg_data(&msg)), zmq_msg_size(&msg));
+}
+
 void* pzmq_data::data() {
 
     return zmq_msg_data(&msg);
@@ -38,84 +67,172 @@ zmq_msg_t* pzmq_data::get() {
 }
 
 /**
- * 这个 get_param 函数是用来从消息数据中提取参数的，
- * 它实现了一个简单的参数编码/解码协议：
- * 
+ * 参数编码/解码协议（多字段帧）：
+ *
  * 数据格式：
- * 消息数据按以下格式存储：
- * [param0_length][param0_data][param1_data]
- * 第一个字节存储 param0 的长度
- * 接下来是 param0 的实际数据
- * 剩余部分是 param1 的数据
- * 
- * 参数提取逻辑：
- * index = 0（偶数）：提取第一个参数
- * 从位置 1 开始，长度为 data[0]
- * index = 1（奇数）：提取第二个参数
- * 从位置 data[0] + 1 开始，长度为剩余所有数据
- * 
- * 使用场景：
- * 在 RPC 示例中可以看到：
+ * 消息数据由任意多个字段依次拼接而成，每个字段为
+ * [varint 长度][字段数据]
+ * 长度使用 varint 编码：每个字节低 7 位存数据，最高位为 1 表示后面还有长度字节
+ * 长度小于 128 的字段只需要 1 个字节的长度前缀，任意长度的 URL 和负载都能正确往返
+ *
+ * 数据布局示例：
+ * [5][h][e][l][l][o][5][w][o][r][l][d]
+ *  ↑  ←─ param0 ─→  ↑  ←─ param1 ─→
+ * get_param(0) 返回 "hello"
+ * get_param(1) 返回 "world"
+ *
+ * 原来的格式只用一个 char 存 param0 的长度，超过 127 字节就会被截断/解析错位，
+ * 而且只能拆成两个字段，需要嵌套 set_param 才能传多个值
+ */
+namespace {
+
+const char *read_varint(const char *pos, const char *end, size_t &value) {
+    value = 0;
+    for (int shift = 0; (pos < end) && (shift < 64); shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*pos++);
+        value |= static_cast<size_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return pos;
+        }
+    }
+    return nullptr;
+}
+
+void write_varint(std::string &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+size_t varint_length(size_t value) {
+    size_t length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++length;
+    }
+    return length;
+}
+
+} // namespace
+
+/**
+ * 从 data 中取出第 index 个字段，返回指向 data 内部的 string_view，不分配内存
+ * 字段不存在或数据格式错误时返回空
+ */
+std::string_view pzmq_data::param_view(std::string_view data, int index) {
+    const char *pos = data.data();
+    const char *end = data.data() + data.size();
+    for (int i = 0; pos && (pos < end); ++i) {
+        size_t length;
+        pos = read_varint(pos, end, length);
+        if ((pos == nullptr) || (length > static_cast<size_t>(end - pos))) {
+            break;
+        }
+        if (i == index) {
+            return std::string_view(pos, length);
+        }
+        pos += length;
+    }
+    return std::string_view();
+}
+
+/**
+ * 直接在收到的 zmq_msg_t 上解析第 index 个字段，返回的 string_view
+ * 在本 pzmq_data 对象存活期间有效
+ */
+std::string_view pzmq_data::get_param_view(int index) {
+    return param_view(view(), index);
+}
+
+int pzmq_data::param_count() {
+    const char *pos = static_cast<const char *>(zmq_msg_data(&msg));
+    const char *end = pos + zmq_msg_size(&msg);
+    int count = 0;
+    while (pos && (pos < end)) {
+        size_t length;
+        pos = read_varint(pos, end, length);
+        if ((pos == nullptr) || (length > static_cast<size_t>(end - pos))) {
+            break;
+        }
+        pos += length;
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * 兼容原来的接口：idata 不为空时从 idata 中解析，否则从内部消息中解析
+ * 使用示例：
  * std::string param0 = msg->get_param(0);  // 获取第一个参数
  * std::string param1 = msg->get_param(1);  // 获取第二个参数
- * 这样就能从一条消息中解析出多个参数，
- * 配合 set_param 静态方法实现参数的打包和解包。
  */
 std::string pzmq_data::get_param(int index, const std::string& idata) {
-    const char *data = nullptr;
-    int size = 0;
-
-    /**
-     * 这段代码是在决定数据来源：
-     * 两种数据源选择：
-     * 使用外部数据（idata.length() > 0）：
-     * 使用内部消息数据（else）
-     * 
-     *  data 是指向传入数据源的起始位置。
-     * idata.c_str() 返回一个指向  idata 字符串内部数据的指针（C风格字符数组的起始位置）。
-     * 这样  data 指针就指向了外部传入的字符串数据的第一个字符，
-     * 后续的参数提取操作将基于这个起始位置进行偏移计算
-     */
     if (idata.length() > 0) {
-        data = idata.c_str(); // 使用传入的  idata 参数作为数据源
-        size = static_cast<int>(idata.length()); // 获取外部数据的长度
-    } else {
-        data = static_cast<const char *>(zmq_msg_data(&msg)); // 使用对象内部的 ZMQ 消息数据
-        size = static_cast<int>(zmq_msg_size(&msg));// 获取内部消息的长度
+        return std::string(param_view(idata, index));
     }
+    return std::string(get_param_view(index));
+}
+
+std::string pzmq_data::set_param(std::string_view param0, std::string_view param1) {
+    return set_params({param0, param1});
+}
 
-    /**
-     * 这段代码是根据  index 参数来提取不同位置的参数：
-     * 
-     * 当  index 为偶数（0, 2, 4...）时
-     * data + 1：从第2个字节开始（跳过长度字节）
-     * data[0]：第1个字节存储的长度值
-     * 提取第一个参数
-     * 
-     * 当  index 为奇数（1, 3, 5...）时
-     * data + data[0] + 1：跳过长度字节 + 第一个参数的所有数据
-     * size - data[0] - 1：总长度 - 第一个参数长度 - 长度字节 = 第二个参数长度
-     * 提取第二个参数
-     * 
-     * 数据布局示例：
-     * [5][h][e][l][l][o][w][o][r][l][d]
-     *  ↑   ←─── param0 ───→ ←─ param1 ─→
-     * 长度
-     * get_param(0) 返回 "hello"
-     * get_param(1) 返回 "world"
-     */
-    if ((index % 2) == 0) {
-        return std::string(data + 1, static_cast<size_t>(data[0]));
-    } else {
-        return std::string(data + data[0] + 1, static_cast<size_t>(size - data[0] - 1));
+/**
+ * 把任意多个字段编码成一条消息，先算出总长度，只分配一次内存
+ * 示例：pzmq_data::set_params({work_id, output_url, inference_url})
+ */
+std::string pzmq_data::set_params(std::initializer_list<std::string_view> params) {
+    size_t total = 0;
+    for (auto &param : params) {
+        total += varint_length(param.size()) + param.size();
     }
+    std::string data;
+    data.reserve(total);
+    for (auto &param : params) {
+        write_varint(data, param.size());
+        data.append(param.data(), param.size());
+    }
+
+    return data;
 }
 
-std::string pzmq_data::set_param(std::string param0, std::string param1) {
-    std::string data = " " + param0 + param1;
-    data[0] = static_cast<char>(param0.length());
+pzmq_data_pool::pzmq_data_pool(size_t capacity) : capacity_(capacity), next_(0), hits_(0), misses_(0) {
+    slots_.reserve(capacity_);
+}
 
+/**
+ * 从上次的位置开始轮询查找空闲对象，找到则复用（命中），
+ * 否则新分配一个（未命中），池未满时把新对象也放进池里
+ */
+std::shared_ptr<pzmq_data> pzmq_data_pool::acquire() {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        auto &slot = slots_[next_];
+        next_ = (next_ + 1) % slots_.size();
+        if (slot.use_count() == 1) {
+            // use_count() 是 relaxed 读取，最后一个使用者可能在别的线程（反应器工作线程、保存了消息的回调），
+            // 加 acquire 屏障与它释放引用时的 release 同步，之后 reset() 才不会和它最后的读取竞争（ARM 上可见）
+            std::atomic_thread_fence(std::memory_order_acquire);
+            slot->reset();
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<pzmq_data> data = std::make_shared<pzmq_data>();
+    if (slots_.size() < capacity_) {
+        slots_.push_back(data);
+    }
     return data;
 }
 
-} // namespace StackFlows
\ No newline at end of file
+uint64_t pzmq_data_pool::hits() const {
+    return hits_.load(std::memory_order_relaxed);
+}
+
+uint64_t pzmq_data_pool::misses() const {
+    return misses_.load(std::memory_order_relaxed);
+}
+
+} // namespace StackFlows
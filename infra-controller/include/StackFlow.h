@@ -8,15 +8,19 @@
 #include <functional>
 #include <unordered_map>
 #include <mutex>
-#include <eventpp/eventqueue.h>
+#include <deque>
+#include <eventpp/eventdispatcher.h>
 #include <thread>
 #include <memory>
-#include <regex>
+#include <vector>
 
 #include "json.hpp"
 #include "pzmq.hpp"
+#include "pzmq_push_cache.hpp"
 #include "StackFlowUtil.h"
 #include "channel.h"
+#include "event_lanes.h"
+#include "channel_table.h"
 
 namespace StackFlows {
 
@@ -31,24 +35,97 @@ public:
     } LOCAL_EVENT;
 
     std::string  unit_name;
+
+    // 最近一次请求的 request_id 和回复地址，只保留给子类读取，send() 使用当前线程的 current_request()
     std::string request_id_;
     std::string out_zmq_url_;
+    std::mutex request_mtx_;
 
     std::atomic<bool> exit_flage_;
     std::atomic<int> status_;
 
-    // 线程安全的事件队列，存储事件类型
-    eventpp::EventQueue<int, void(const std::shared_ptr<void> &)> event_queue_;
-    std::unique_ptr<std::thread> even_loop_thread_;
+    // 事件类型到处理函数的映射，由 event_lanes_ 的工作线程调用
+    eventpp::EventDispatcher<int, void(const std::shared_ptr<void> &)> event_dispatcher_;
+
+    // 分道事件队列：exit/pause、setup、taskinfo 各走一条道，慢的 setup 不再堵住 exit
+    event_lanes event_lanes_;
 
     std::unique_ptr<pzmq> rpc_ctx;
 
-    std::unordered_map<int, std::shared_ptr<llm_channel_obj>> llm_task_channel_;
+    // 任务通道表，事件在多个线程上按 work_id 并行处理，表本身是线程安全的
+    channel_table llm_task_channel_;
+
+    /**
+     * 预注册池（warm pool）：
+     * setup 原来要先同步调用 sys 的 register_unit，再创建通道（绑定 PUB），都在事件处理的关键路径上
+     * set_warm_pool(n) 在启动时预先注册 n 个 work_id 并创建好通道，sys_register_unit 直接从池里取，
+     * 取走后用 unit_call_async 在后台补充，补充的回调在异步客户端的 io 线程里执行，
+     * 所以池的状态放在 shared_ptr 里，单元析构后回来的注册结果会直接释放掉
+     * 池里的 work_id 在 unit-manager 看来已经分配，单元析构时逐个释放
+     */
+    struct warm_pool_state {
+        std::mutex mtx;
+        std::deque<std::pair<int, std::shared_ptr<llm_channel_obj>>> channels;
+        int size = 0;
+        int inflight = 0; // 已经发出、还没有返回的异步注册
+        bool closed = false;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t failed = 0; // 注册失败（sys 不可用、端口耗尽），包括池未命中时的同步注册
+    };
+    std::shared_ptr<warm_pool_state> warm_pool_;
+
+    // 在子类构造函数里调用，同步注册 size 个 work_id 填满预注册池
+    void set_warm_pool(int size);
+    static void warm_pool_refill(const std::shared_ptr<warm_pool_state> &state, const std::string &unit_name);
+    std::string _rpc_warm_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data);
 
     StackFlow(const std::string &unit_name);
-    void even_loop();
     void _none_event(const std::shared_ptr<void> &arg);
 
+    /**
+     * 事件放进对应的道：EVENT_EXIT/EVENT_PAUSE 走控制道，EVENT_SETUP 走 setup 道，其它走 info 道
+     * 道内按请求里的 work_id 编号串行（strand），同一个任务的事件保持顺序，不同任务之间并行；
+     * setup 和没有具体 work_id 的请求不需要串行
+     */
+    static int event_lane(int event);
+    static int event_key(int event, const std::shared_ptr<pzmq_data> &data);
+    void enqueue_event(int event, const std::shared_ptr<pzmq_data> &data);
+
+    /**
+     * 设置某条道（event_lanes::LANE_*）的工作线程数，只能增加
+     * 默认每条道一个线程，大于 1 时不同任务的事件会并行调用 setup/exit/pause/taskinfo，
+     * 子类自己的任务表等状态要能承受并发访问
+     */
+    void set_lane_workers(int lane, int count) {
+        event_lanes_.set_workers(lane, count);
+    }
+
+    std::string _rpc_lane_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data);
+
+    /**
+     * 当前线程正在处理的请求：
+     * 事件分道后 setup 和 exit/pause 可能在不同线程里同时执行，
+     * 共用 request_id_、out_zmq_url_ 会把回复发给别的请求，所以按线程保存
+     */
+    struct request_context {
+        std::string request_id;
+        std::string zmq_url;
+    };
+
+    static request_context &current_request() {
+        static thread_local request_context ctx;
+        return ctx;
+    }
+
+    void set_request(const std::string &request_id, const std::string &zmq_url) {
+        current_request().request_id = request_id;
+        current_request().zmq_url = zmq_url;
+        std::unique_lock<std::mutex> lock(request_mtx_);
+        request_id_ = request_id;
+        out_zmq_url_ = zmq_url;
+    }
+
     template <typename T>
     std::shared_ptr<llm_channel_obj> get_channel(T workid) {
         int _work_id_num;
@@ -71,8 +148,7 @@ public:
         std::string zmq_url = originalPtr->get_param(0);
         std::string data = priginalPtr->get_param(1);
 
-        request_id_ = sample_josn_str_get(data, "request_id");
-        out_zmq_url_ = zmq_url;
+        set_request(sample_json_str_get(data, "request_id"), zmq_url);
         if (status_.load()) setup(zmq_url, data);
     }
     virtual int setup(const std::string &zmq_url, const std::string &raw);
@@ -83,8 +159,7 @@ public:
         std::shared_ptr<pzmq_data> originakPtr = std::static_pointer_cast<pzmq_data>(arg);
         std::string zmq_url = originalPtr->get_param(0);
         std::string data = originalPtr->get_param(1);
-        request_id_ = sample_json_str_get(data, "request_id");
-        out_zmq_url_ = zmq_url;
+        set_request(sample_json_str_get(data, "request_id"), zmq_url);
         if (status_.load()) {
             exit(zmq_url, data);
         }
@@ -97,8 +172,7 @@ public:
         std::shared_ptr<pzmq_data> originalPtr = std::static_pointer_cast<pzmq_data>(arg);
         std::string zmq_url = originalPtr->get_param(0);
         std::string data = originalPtr->get_param(1);
-        request_id_ = sample_json_str_get(data, "request_id");
-        out_zmq_url_ = zmq_url;
+        set_request(sample_json_str_get(data, "request_id"), zmq_url);
         if (status_.load()) {
             pause(zmq_url, data);
         }
@@ -127,8 +201,7 @@ public:
         std::shared_ptr<pzmq_data> originalPtr = std::static_pointer_cast<pzmq_data>(arg);
         std::string zmq_url = originalPtr->get_param(0);
         std::string data = originalPtr->get_param(1);
-        request_id_ = sample_json_str_get(data, "request_id");
-        out_zmq_url_ = zmq_url;
+        set_request(sample_json_str_get(data, "request_id"), zmq_url);
         if (status_.load()) {
             taskinfo(zmq_url, data);
         }
@@ -142,15 +215,23 @@ public:
     int send(const std::string &object, const nlohmann::json &data, const std::string &error_msg, 
             const std::string &work_id, const std::string &zmq_url = "") {
         
-        // 1. 构造JSON响应体
+        // 1. 取当前线程的请求上下文，不在事件处理线程里（如推理线程）时退回最近一次请求
+        request_context request = current_request();
+        if (request.zmq_url.empty()) {
+            std::unique_lock<std::mutex> lock(request_mtx_);
+            request.request_id = request_id_;
+            request.zmq_url = out_zmq_url_;
+        }
+
+        // 2. 构造JSON响应体
         nlohmann::json out_body;
-        out_body["request_id"] = request_id_;
+        out_body["request_id"] = request.request_id;
         out_body["work_id"] = work_id;
         out_body["created"] = time(NULL);
         out_body["object"] = object;
         out_body["data"] = data;
 
-        // 2. 处理错误信息
+        // 3. 处理错误信息
         if (error_msg.empty()) {
             out_body["error"]["code"] = 0;
             out_body["error"]["message"] = "";
@@ -158,26 +239,12 @@ public:
             out_body["error"] = error_msg;
         }
 
-        // 3. 选择发送目标
-        if (zmq_url.empty()) {
-
-            // 使用默认URL
-            pzmq _zmq(out_zmq_url_, ZMQ_PUSH);
+        // 4. 发送消息，out 移交给 libzmq，不再拷贝
+        std::string out = out_body.dump();
+        out += "\n";
 
-            // 4. 发送消息
-            std::string out = out_body.dump();
-            out += "\n";
-            return _zmq.send_data(out);
-        } else {
-
-            // 使用默认URL
-            pzmq _zmq(zmq_url, ZMQ_PUSH);
-
-            // 4. 发送消息
-            std::string out = out_body.dump();
-            out += "\n";
-            return _zmq.send_data(out);
-        }
+        // 5. 选择发送目标，zmq_url 为空时使用请求的回复地址，PUSH 套接字来自进程级缓存
+        return pzmq_push_cache::instance().send(zmq_url.empty() ? request.zmq_url : zmq_url, std::move(out));
     }
 
     std::string sys_sql_select(const std::string &key);
@@ -206,8 +273,7 @@ public:
         }
         pzmq _call("sys");
         _call.call_rpc_action("release_unit", _work_id, [](pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {});
-        llm_task_channel_[_work_id_num].reset();
-        llm_task_channel_.erase(_work_id_num);
+        llm_task_channel_.take(_work_id_num);
         
         return false;
     }
@@ -216,4 +282,29 @@ public:
     ~StackFlow();
 };
 
+/**
+ * stackflow_embed 是嵌入模式的单元注册表：
+ * 单元的代码链接进 unit-manager 进程后，用 add() 登记一个创建函数，
+ * unit-manager 在 sys RPC 服务起来之后按配置调用 start() 创建单元，退出时 stop_all() 按创建的逆序销毁
+ *
+ * 嵌入的单元和 unit-manager 共用一个 ZMQ 上下文，配合 pzmq_context::set_inproc(true)，
+ * 单元和 unit-manager 之间的所有地址都会被改写成 inproc://
+ *
+ * 注意：单元如果是静态库，STACKFLOW_EMBED_UNIT 所在的目标文件要用 --whole-archive 链接，
+ * 否则没有被引用的目标文件会被链接器丢掉，登记代码不会执行
+ */
+class stackflow_embed {
+public:
+    using factory = std::function<std::unique_ptr<StackFlow>()>;
+
+    static int add(const std::string &unit_name, const factory &make);
+    static int start(const std::string &unit_name);
+    static void stop_all();
+    static std::vector<std::string> list();
+};
+
+#define STACKFLOW_EMBED_UNIT(_unit_name, _class)                                                         \
+    static int _stackflow_embed_##_class = StackFlows::stackflow_embed::add(                              \
+        _unit_name, []() -> std::unique_ptr<StackFlows::StackFlow> { return std::make_unique<_class>(_unit_name); })
+
 } // namespace StackFlows;
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <unordered_map>
 #include <list>
@@ -14,9 +16,30 @@
 
 namespace StackFlows {
 
-std::string sample_json_str_get(const std::string &json_str, const std::string &json_key);
-int sample_get_work_id_num(const std::string &work_id);
-std::string sample_get_work_id_name(const std::string &work_id);
+std::string sample_json_str_get(std::string_view json_str, std::string_view json_key);
+int sample_json_fields_get(std::string_view json_str, const std::string_view *keys,
+                            std::string_view *values, int count);
+
+/**
+ * 一次扫描取出多个顶层字段，返回的 string_view 指向 json_str 内部
+ * 示例：auto f = sample_json_fields_get(raw, {"request_id", "work_id", "object", "data"});
+ */
+template <size_t N>
+std::array<std::string_view, N> sample_json_fields_get(std::string_view json_str, const std::string_view (&keys)[N]) {
+    std::array<std::string_view, N> values;
+    sample_json_fields_get(json_str, keys, values.data(), static_cast<int>(N));
+    return values;
+}
+
+/**
+ * 把 str 按 JSON 字符串规则转义后追加到 out（不含两边的引号），输出与 nlohmann::json::dump() 一致
+ * 只转义引号、反斜杠和控制字符，UTF-8 原样输出，不做校验
+ */
+void sample_json_escape_append(std::string &out, std::string_view str);
+
+bool split_work_id(std::string_view work_id, std::string_view &name, int &num);
+int sample_get_work_id_num(std::string_view work_id);
+std::string sample_get_work_id_name(std::string_view work_id);
 std::string sample_get_work_id(int work_id_num, const std::string &unit_time);
 bool decode_stream(const std::string &i, std::string &out, 
                     std::unordered_map<int, std::string> &stream_buff);
@@ -25,6 +48,9 @@ std::string unit_call(const std::string &unit_name, const std::string &unit_acti
 void unit_call(const std::string &unit_name, const std::string &unit_action, 
                 const std::string &data, 
                 std::function<void(const std::shared_ptr<StackFlows::pzmq_data> &)> callback);
+void unit_call_async(const std::string &unit_name, const std::string &unit_action,
+                const std::string &data,
+                std::function<void(int, const std::shared_ptr<StackFlows::pzmq_data> &)> callback);
 
 bool file_exists(const std::string &filePath);
 void unicode_to_utf8(unsigned int codepoint, char *output, int *length);
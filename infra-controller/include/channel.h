@@ -11,7 +11,8 @@
 #include <eventpp/eventqueue.h>
 #include <thread>
 #include <memory>
-#include <regex>
+#include <string_view>
+#include <ctime>
 
 #include "json.hpp"
 #include "pzmq.hpp"
@@ -43,6 +44,22 @@ private:
     // 通用subscriber接口
     std::unordered_map<std::string, int> zmq_url_map_; // url到索引的映射
 
+    /**
+     * 流式输出的预渲染信封，见 send_stream()
+     * stream_tail_ 是 data 之后不变的部分（error、object、request_id、work_id），
+     * 只在 object、request_id、work_id 变化时重新渲染；stream_created_ 是渲染好的 created 秒数
+     */
+    std::mutex stream_mtx_;
+    std::string stream_object_;
+    std::string stream_request_id_;
+    std::string stream_work_id_;
+    std::string stream_tail_;
+    time_t stream_time_ = 0;
+    std::string stream_created_;
+    std::string stream_buff_; // 复用的输出缓冲区
+
+    void render_stream_tail(const std::string& object, const std::string& work_id);
+
 public:
     std::string unit_name_; // 单元名称
     bool enoutput_; // 是否启用输出
@@ -84,10 +101,23 @@ public:
     void stop_subscriber(const std::string& zmq_url);
     int send_raw_to_pub(const std::string& raw);
     int send_raw_to_usr(const std::string& raw);
+    int send_raw_to_pub(const std::shared_ptr<const std::string>& raw);
+    int send_raw_to_usr(const std::shared_ptr<const std::string>& raw);
     void set_push_url();
     void cear_push_url();
     static int send_raw_for_url(const std::string& zmq_url, const std::string& raw);
 
+    /**
+     * 流式输出一个片段，输出与 send(object, {"delta":delta,"finish":finish,"index":index}, LLM_NO_ERROR) 相同：
+     * {"created":1700000000,"data":{"delta":"Hello","finish":false,"index":0},"error":{"code":0,"message":""},
+     *  "object":"llm.utf-8.stream","request_id":"2","work_id":"llm.1000"}
+     *
+     * send() 每个 token 都要构造一棵 nlohmann::json 再 dump()，这里只把转义后的 delta、index、finish
+     * 拼进复用的缓冲区，信封的其余部分每个任务渲染一次
+     */
+    int send_stream(const std::string& object, std::string_view delta, int index, bool finish,
+                    const std::string& work_id = "");
+
     int send(const std::string& object, const nlohmann::json& data, 
             const std::string& error_msg,
             const std::string& work_id = "") {
@@ -107,9 +137,11 @@ public:
         std::string out = out_body.dump();
         out += "\n";
 
-        send_raw_to_pub(out);
+        // 同一份数据发给 PUB 和用户 PUSH，用引用计数的数据块零拷贝发送
+        auto out_blob = std::make_shared<const std::string>(std::move(out));
+        send_raw_to_pub(out_blob);
         if (enoutput_) {
-            return send_raw_to_usr(out);
+            return send_raw_to_usr(out_blob);
         }
         return 0;
     }
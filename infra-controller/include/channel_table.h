@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "channel.h"
+
+namespace StackFlows {
+
+/**
+ * channel_table 是 StackFlow 的任务通道表（work_id 编号 -> llm_channel_obj）：
+ * 事件按 work_id 在多个线程上并行处理，注册、释放和查找通道可能同时发生，
+ * 原来的 std::unordered_map 没有任何保护
+ *
+ * 1. 读多写少：查找用共享锁，注册和释放用独占锁
+ * 2. 只返回 shared_ptr 的拷贝，不暴露迭代器，通道在别的线程被释放时手里的指针仍然有效
+ * 3. take() 把通道从表里移出来再返回，调用者在锁外销毁，通道析构（停止订阅线程）不会占着锁
+ */
+class channel_table {
+public:
+    using channel_ptr = std::shared_ptr<llm_channel_obj>;
+
+private:
+    mutable std::shared_mutex mtx_;
+    std::unordered_map<int, channel_ptr> channels_;
+
+public:
+    // 与 std::unordered_map::at 一致，找不到时抛出 std::out_of_range
+    channel_ptr at(int work_id_num) const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        return channels_.at(work_id_num);
+    }
+
+    // 找不到时返回 nullptr
+    channel_ptr find(int work_id_num) const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        auto iteam = channels_.find(work_id_num);
+        if (iteam == channels_.end()) {
+            return nullptr;
+        }
+        return iteam->second;
+    }
+
+    void set(int work_id_num, channel_ptr channel) {
+        std::unique_lock<std::shared_mutex> lock(mtx_);
+        channels_[work_id_num] = std::move(channel);
+    }
+
+    channel_ptr take(int work_id_num) {
+        channel_ptr channel;
+        std::unique_lock<std::shared_mutex> lock(mtx_);
+        auto iteam = channels_.find(work_id_num);
+        if (iteam != channels_.end()) {
+            channel = std::move(iteam->second);
+            channels_.erase(iteam);
+        }
+        return channel;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        return channels_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // 当前所有通道的快照，用于遍历（任务列表、析构时逐个释放）
+    std::vector<std::pair<int, channel_ptr>> snapshot() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        return std::vector<std::pair<int, channel_ptr>>(channels_.begin(), channels_.end());
+    }
+};
+
+} // namespace StackFlows
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+
+#include "sample_log.h"
+
+namespace StackFlows {
+
+/**
+ * event_lanes 是 StackFlow 的分道事件队列：
+ *
+ * 背景：
+ * 原来所有事件放在一个 eventpp::EventQueue 里，由一个 even_loop 线程严格按 FIFO 处理，
+ * 一个慢的 setup（加载模型可能要几秒）会把后面紧急的 exit、pause 都堵住
+ *
+ * 设计：
+ * 1. 三条道：LANE_CONTROL（exit、pause）、LANE_SETUP（setup）、LANE_INFO（taskinfo 等查询）
+ * 2. 每条道有自己的队列和工作线程（默认各 1 个），道与道之间互不阻塞，道内按 FIFO 处理
+ * 3. 工作线程数可以用 set_workers() 增加，不支持减少
+ * 4. 每条道记录排队延迟（入队到开始处理）的直方图：第 i 个桶统计 [2^(i-1), 2^i) us，
+ *    第 0 个桶是 < 1us，最后一个桶是溢出，用 stats() 以 JSON 输出
+ * 5. 按 key（work_id 编号）串行：同一个 key 的事件在道内组成一个 strand，按入队顺序、同一时刻只在一个
+ *    工作线程里执行；不同 key 的事件在道的多个工作线程上并行，llm.1000 的 setup/exit 不再排在 llm.1001 后面
+ *    key < 0 表示不需要串行（如新建任务的 setup），直接并行执行
+ *
+ * 注意：串行只在一条道内保证，不同道的事件即使 key 相同也可能同时执行（exit 本来就要能越过 taskinfo）
+ */
+class event_lanes {
+public:
+    using dispatch_fun = std::function<void(int, const std::shared_ptr<void> &)>;
+
+    enum { LANE_CONTROL = 0, LANE_SETUP, LANE_INFO, LANE_COUNT };
+
+    static constexpr int histogram_buckets = 24;
+
+private:
+    struct lane_event {
+        int type;
+        std::shared_ptr<void> arg;
+        std::chrono::steady_clock::time_point enqueue_time;
+    };
+
+    struct strand {
+        int key;
+        bool scheduled; // 在就绪队列里或者正在执行
+        std::deque<lane_event> events;
+    };
+
+    struct lane {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::shared_ptr<strand>> ready;
+        std::unordered_map<int, std::shared_ptr<strand>> strands; // 有事件排队或正在执行的 key
+        size_t pending;
+        std::vector<std::unique_ptr<std::thread>> workers;
+        std::atomic<uint64_t> histogram[histogram_buckets];
+        std::atomic<uint64_t> processed;
+        std::atomic<uint64_t> max_wait_us;
+    };
+
+    dispatch_fun dispatch_;
+    std::atomic<bool> exit_flage_;
+    std::mutex workers_mtx_;
+    lane lanes_[LANE_COUNT];
+
+    static const char *lane_name(int index) {
+        static const char *names[LANE_COUNT] = {"control", "setup", "info"};
+        return names[index];
+    }
+
+    void record_wait(lane &ln, uint64_t wait_us) {
+        int bucket = 0;
+        if (wait_us > 0) {
+            bucket = 64 - __builtin_clzll(wait_us);
+            if (bucket >= histogram_buckets) {
+                bucket = histogram_buckets - 1;
+            }
+        }
+        ln.histogram[bucket]++;
+        ln.processed++;
+        uint64_t max_wait = ln.max_wait_us.load();
+        while ((wait_us > max_wait) && (!ln.max_wait_us.compare_exchange_weak(max_wait, wait_us))) {
+        }
+    }
+
+    void worker_loop(int index) {
+        char name[16];
+        snprintf(name, sizeof(name), "even_%s", lane_name(index));
+        pthread_setname_np(pthread_self(), name);
+
+        lane &ln = lanes_[index];
+        while (true) {
+            std::shared_ptr<strand> st;
+            lane_event event;
+            {
+                std::unique_lock<std::mutex> lock(ln.mtx);
+                ln.cv.wait(lock, [this, &ln]() { return exit_flage_.load() || !ln.ready.empty(); });
+                if (exit_flage_.load()) {
+                    break;
+                }
+                st = ln.ready.front();
+                ln.ready.pop_front();
+                event = std::move(st->events.front());
+                st->events.pop_front();
+                ln.pending--;
+            }
+            auto wait = std::chrono::steady_clock::now() - event.enqueue_time;
+            record_wait(ln, std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+            try {
+                dispatch_(event.type, event.arg);
+            } catch (...) {
+                ALOGE("event %d on lane %s throw exception", event.type, lane_name(index));
+            }
+
+            // 一次只执行 strand 的一个事件，还有剩余就排到队尾，和其它 key 轮流执行
+            std::unique_lock<std::mutex> lock(ln.mtx);
+            if (!st->events.empty()) {
+                ln.ready.push_back(st);
+                lock.unlock();
+                ln.cv.notify_one();
+            } else {
+                st->scheduled = false;
+                if (st->key >= 0) {
+                    ln.strands.erase(st->key);
+                }
+            }
+        }
+    }
+
+public:
+    explicit event_lanes(const dispatch_fun &dispatch) : dispatch_(dispatch), exit_flage_(false) {
+        for (auto &ln : lanes_) {
+            for (auto &bucket : ln.histogram) {
+                bucket = 0;
+            }
+            ln.pending = 0;
+            ln.processed = 0;
+            ln.max_wait_us = 0;
+        }
+    }
+
+    event_lanes(const event_lanes &) = delete;
+    event_lanes &operator=(const event_lanes &) = delete;
+
+    // 把道的工作线程数增加到 count，count 不大于当前线程数时什么都不做
+    void set_workers(int index, int count) {
+        if ((index < 0) || (index >= LANE_COUNT) || exit_flage_.load()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(workers_mtx_);
+        lane &ln = lanes_[index];
+        while (static_cast<int>(ln.workers.size()) < count) {
+            ln.workers.push_back(std::make_unique<std::thread>(std::bind(&event_lanes::worker_loop, this, index)));
+        }
+    }
+
+    int get_workers(int index) {
+        std::unique_lock<std::mutex> lock(workers_mtx_);
+        return static_cast<int>(lanes_[index].workers.size());
+    }
+
+    void enqueue(int index, int key, int type, const std::shared_ptr<void> &arg) {
+        lane &ln = lanes_[index];
+        {
+            std::unique_lock<std::mutex> lock(ln.mtx);
+            std::shared_ptr<strand> st;
+            if (key >= 0) {
+                std::shared_ptr<strand> &slot = ln.strands[key];
+                if (!slot) {
+                    slot = std::make_shared<strand>();
+                    slot->key = key;
+                    slot->scheduled = false;
+                }
+                st = slot;
+            } else {
+                st = std::make_shared<strand>();
+                st->key = key;
+                st->scheduled = false;
+            }
+            st->events.push_back({type, arg, std::chrono::steady_clock::now()});
+            ln.pending++;
+            if (st->scheduled) {
+                return;
+            }
+            st->scheduled = true;
+            ln.ready.push_back(st);
+        }
+        ln.cv.notify_one();
+    }
+
+    size_t depth(int index) {
+        std::unique_lock<std::mutex> lock(lanes_[index].mtx);
+        return lanes_[index].pending;
+    }
+
+    // 道内当前有事件排队或正在执行的 key 个数
+    size_t strands(int index) {
+        std::unique_lock<std::mutex> lock(lanes_[index].mtx);
+        return lanes_[index].strands.size();
+    }
+
+    /**
+     * 输出各条道的统计：
+     * {"control":{"workers":1,"depth":0,"strands":0,"processed":12,"max_wait_us":35,"histogram":[0,3,9,...]},...}
+     */
+    std::string stats() {
+        std::string out = "{";
+        for (int i = 0; i < LANE_COUNT; ++i) {
+            lane &ln = lanes_[i];
+            if (i) {
+                out += ",";
+            }
+            out += "\"";
+            out += lane_name(i);
+            out += "\":{\"workers\":" + std::to_string(get_workers(i));
+            out += ",\"depth\":" + std::to_string(depth(i));
+            out += ",\"strands\":" + std::to_string(strands(i));
+            out += ",\"processed\":" + std::to_string(ln.processed.load());
+            out += ",\"max_wait_us\":" + std::to_string(ln.max_wait_us.load());
+            out += ",\"histogram\":[";
+            for (int n = 0; n < histogram_buckets; ++n) {
+                if (n) {
+                    out += ",";
+                }
+                out += std::to_string(ln.histogram[n].load());
+            }
+            out += "]}";
+        }
+        out += "}";
+
+        return out;
+    }
+
+    // 停止所有工作线程，正在处理的事件会执行完，队列里剩下的事件被丢弃
+    void stop() {
+        exit_flage_ = true;
+        for (auto &ln : lanes_) {
+            {
+                std::unique_lock<std::mutex> lock(ln.mtx);
+            }
+            ln.cv.notify_all();
+        }
+        std::unique_lock<std::mutex> lock(workers_mtx_);
+        for (auto &ln : lanes_) {
+            for (auto &worker : ln.workers) {
+                if (worker->joinable()) {
+                    worker->join();
+                }
+            }
+            ln.workers.clear();
+        }
+    }
+
+    ~event_lanes() {
+        stop();
+    }
+};
+
+} // namespace StackFlows
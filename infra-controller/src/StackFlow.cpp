@@ -14,13 +14,16 @@ using namespace StackFlows;
  * rpc_ctx_(std::make_unique<pzmq>(unit_name))  // 创建RPC通信上下文
  */
 StackFlow::StackFlow::StackFlow(const std::string &unit_name)
-    : unit_name_(unit_name), rpc_ctx_(std::make_unique<pzmq>(unit_name)) {
+    : unit_name_(unit_name),
+      event_lanes_([this](int event, const std::shared_ptr<void> &arg) { event_dispatcher_.dispatch(event, arg); }),
+      rpc_ctx_(std::make_unique<pzmq>(unit_name)) {
     // 注册事件监听器 - 绑定本地事件处理函数
-    event_queue_.appendListener(LOCAL_EVENT::EVENT_NONE, std::bind(&StackFlow::_none_event, this, std::placeholders::_1));
-    event_queue_.appendListener(LOCAL_EVENT::EVENT_PAUSE, std::bind(&StackFlow::_pause, this, std::placeholders::_1));
-    event_queue_.appendListener(LOCAL_EVENT::EVENT_EXIT, std::bind(&StackFlow::_exit, this, std::placeholders::_1));
-    event_queue_.appendListener(LOCAL_EVENT::EVENT_SETUP, std::bind(&StackFlow::_setup, this, std::placeholders::_1));
-    event_queue_.appendListener(LOCAL_EVENT::EVENT_TASKINFO,
+    event_dispatcher_.appendListener(LOCAL_EVENT::EVENT_NONE,
+        std::bind(&StackFlow::_none_event, this, std::placeholders::_1));
+    event_dispatcher_.appendListener(LOCAL_EVENT::EVENT_PAUSE, std::bind(&StackFlow::_pause, this, std::placeholders::_1));
+    event_dispatcher_.appendListener(LOCAL_EVENT::EVENT_EXIT, std::bind(&StackFlow::_exit, this, std::placeholders::_1));
+    event_dispatcher_.appendListener(LOCAL_EVENT::EVENT_SETUP, std::bind(&StackFlow::_setup, this, std::placeholders::_1));
+    event_dispatcher_.appendListener(LOCAL_EVENT::EVENT_TASKINFO,
         std::bind(&StackFlow::_taskinfo, this, std::placeholders::_1));
     
     // 注册RPC动作 - 绑定远程调用处理函数
@@ -32,47 +35,82 @@ StackFlow::StackFlow::StackFlow(const std::string &unit_name)
                                     std::bind(&StackFlow::_rpc_exit, this, std::placeholders::_1, std::placeholders::_2));
     rpc_ctx_->register_rpc_action(
         "taskinfo", std::bind(&StackFlow::_rpc_taskinfo, this, std::placeholders::_1, std::placeholders::_2));
+    rpc_ctx_->register_rpc_action(
+        "lane_stats", std::bind(&StackFlow::_rpc_lane_stats, this, std::placeholders::_1, std::placeholders::_2));
+    rpc_ctx_->register_rpc_action(
+        "warm_stats", std::bind(&StackFlow::_rpc_warm_stats, this, std::placeholders::_1, std::placeholders::_2));
     
-    // 启动事件循环线程
+    // 启动事件处理线程，每条道默认一个，子类可以用 set_lane_workers() 增加
     status_.store(0); // 设置初始状态
     exit_flage_.store(false);
-
-    // 设置初始状态
-    even_loop_thread_ = std::make_unique<std::thread>(std::bind(&StackFlow::even_loop, this));
+    for (int lane = 0; lane < event_lanes::LANE_COUNT; ++lane) {
+        event_lanes_.set_workers(lane, 1);
+    }
 
     // 设置初始状态
     status_.store(1);
 }
 
 StackFlow::~StackFlow() {
-    while (1)
-    {
-        exit_flage_.store(true); // 设置退出标志
-        event_queue_.enqueue(EVENT_NONE, nullptr); // 发送空事件唤醒线程
-        even_loop_thread_->join(); // 等待线程结束
-
-        auto iteam = llm_task_channel_.begin(); // 获取第一个通道
+    exit_flage_.store(true); // 设置退出标志
+    event_lanes_.stop(); // 等待正在处理的事件结束，停止所有道的线程
 
-        // 没有更多通道时退出
-        if (iteam == llm_task_channel_.end()) 
+    // 关闭预注册池，池里还没用过的 work_id 还给 sys，还在途的异步注册返回后自己释放
+    if (warm_pool_) {
+        std::deque<std::pair<int, std::shared_ptr<llm_channel_obj>>> channels;
         {
-            break;
+            std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+            warm_pool_->closed = true;
+            channels.swap(warm_pool_->channels);
+        }
+        for (auto &iteam : channels) {
+            unit_call("sys", "release_unit", sample_get_work_id(iteam.first, unit_name_));
         }
-        sys_release_unit(iteam->first, ""); // 没有更多通道时退出
-        iteam->second.reset(); // 重置智能指针
-        llm_task_channel_.erase(iteam->first); // 重置智能指针
     }
-}
 
-void StackFlow::even_loop() {
+    // 逐个释放剩下的通道，sys_release_unit 同时把通道从 llm_task_channel_ 中删除
+    for (auto &iteam : llm_task_channel_.snapshot()) {
+        sys_release_unit(iteam.first, "");
+    }
+}
 
-    // 为当前线程设置名称为 "even_loop"，便于调试和监控
-    pthread_setname_np(pthread_self(), "even_loop");
+int StackFlow::event_lane(int event) {
+    switch (event) {
+        case EVENT_EXIT:
+        case EVENT_PAUSE:
+            return event_lanes::LANE_CONTROL;
+        case EVENT_SETUP:
+            return event_lanes::LANE_SETUP;
+        default:
+            return event_lanes::LANE_INFO;
+    }
+}
 
-    while (!exit_flage_.load()) { // 通过检查  exit_flage_ 原子变量来安全退出循环
-        event_queue_.wait(); // wait() 会阻塞线程直到有新事件入队
-        event_queue_.process(); // process() 处理队列中的所有待处理事件
+/**
+ * 请求的第二个参数是原始 JSON，只取 work_id 字段，"llm.1000" -> 1000
+ * setup 新建任务、work_id 只有单元名（如查询任务列表）或者无法解析时返回 -1，不串行
+ */
+int StackFlow::event_key(int event, const std::shared_ptr<pzmq_data> &data) {
+    if ((event == EVENT_SETUP) || (!data)) {
+        return -1;
     }
+    auto fields = sample_json_fields_get(data->get_param_view(1), {"work_id"});
+    if (fields[0].data() == nullptr) {
+        return -1;
+    }
+    int work_id_num = sample_get_work_id_num(fields[0]);
+    return (work_id_num < 0) ? -1 : work_id_num;
+}
+
+void StackFlow::enqueue_event(int event, const std::shared_ptr<pzmq_data> &data) {
+    event_lanes_.enqueue(event_lane(event), event_key(event, data), event, data);
+}
+
+/**
+ * 查询各条道的工作线程数、积压和排队延迟直方图，直接在 RPC 线程里返回，不经过事件队列
+ */
+std::string StackFlow::_rpc_lane_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
+    return event_lanes_.stats();
 }
 
 void StackFlow::_none_event(const std::shared_ptr<void> &arg)
@@ -81,7 +119,7 @@ void StackFlow::_none_event(const std::shared_ptr<void> &arg)
 }
 
 std::string StackFlow::_rpc_setup(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
-    event_queue_.enqueue(EVENT_SETUP, data);
+    enqueue_event(EVENT_SETUP, data);
 
     return std::string("None");
 }
@@ -91,14 +129,22 @@ int setup(const std::string &zmq_url, const std::string &raw) {
     ALOGI("StackFlow::setup raw zmq_url:%s raw:%s", zmq_url.c_str(), raw.c_str());
 
     int workid_num = sys_register_unit(unit_name_);
+    if (workid_num < 0) {
+        nlohmann::json error_body;
+        error_body["code"] = -19;
+        error_body["message"] = "Unit register failed.";
+        send("None", "None", error_body, unit_name_);
+        return -1;
+    }
     std::stirng work_id = unit_name_ + "." + std::to_string(workid_num);
 
     auto task_channel = get_channel(workid_num);
     task_channel->set_push_url(zmq_url);
-    task_channel->request_id_ = sample_json_str_get(raw, "request_id");
+    auto fields = sample_json_fields_get(raw, {"request_id", "object", "data"});
+    task_channel->request_id_ = std::string(fields[0]);
     task_channel->work_id_ = work_id;
 
-    if (setup(work_id, sample_json_str_get(raw, "object"), sample_json_str_get(raw, "data"))) {
+    if (setup(work_id, std::string(fields[1]), std::string(fields[2]))) {
         sys_release_unit(workid_num, work_id);
     }
 
@@ -116,7 +162,7 @@ int StackFlow::setup(const std::string &work_id, const std::string &object, cons
 }
 
 std::string StackFlow::_rpc_exit(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
-    event_queue_.enqueue(EVENT_EXIT, data);
+    enqueue_event(EVENT_EXIT, data);
 
     return std::string("None");
 }
@@ -130,7 +176,8 @@ std::string StackFlow::_rpc_exit(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &
  */
 int StackFlow::exit(const std::string &zmq_url, const std::string &raw) {
     ALOGI("StacKFlow::exit raw");
-    std::string work_id = sample_json_str_get(raw, "work_id");
+    auto fields = sample_json_fields_get(raw, {"work_id", "object", "data"});
+    std::string work_id(fields[0]);
 
     try {
         auto task_channel = get_channel(sample_get_work_id_num(work_id));
@@ -139,7 +186,7 @@ int StackFlow::exit(const std::string &zmq_url, const std::string &raw) {
         
     }
     
-    if (exit(work_id, sample_json_str_get(raw, "object"), sample_json_str_get(raw, "data")) == 0) {
+    if (exit(work_id, std::string(fields[1]), std::string(fields[2])) == 0) {
         return (int)sys_release_unit(-1, work_id);
     }
 
@@ -163,14 +210,15 @@ int StackFlow::exit(const std::string &work_id, const std::string &object, const
 }
 
 std::string StackFlow::_rpc_pause(pzmq *_pzmq, const std::shared_ptr<pxmw_data> &data) {
-    event_queue_.enqueue(EVENT_PAUSE, data);
+    enqueue_event(EVENT_PAUSE, data);
 
     return std::string("None");
 }
 
 void StackFlow::pause(const std::string &zmq_url, const std::string &raw) {
     ALOGI("StackFlow::pause raw");
-    std::string work_id = sample_json_str_get(raw, "work_id");
+    auto fields = sample_json_fields_get(raw, {"work_id", "object", "data"});
+    std::string work_id(fields[0]);
     try {
         auto task_channel = get_channel(sample_get_work_id_num(work_id));
         task_channel->set_push_url(zmq_url);
@@ -179,7 +227,7 @@ void StackFlow::pause(const std::string &zmq_url, const std::string &raw) {
 
     }
 
-    pause(work_id, sample_json_str_get(raw, "object"), sample_json_str_get(raw, "data"));
+    pause(work_id, std::string(fields[1]), std::string(fields[2]));
 }
 
 void StackFlow::pause(const std::string &work_id, const std::string &object, const std::string &data) {
@@ -192,13 +240,14 @@ void StackFlow::pause(const std::string &work_id, const std::string &object, con
 }
 
 std::string StackFlow::_rpc_taskinfo(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
-    event_queue_.enqueue(EVENT_TASKINFO, data);
+    enqueue_event(EVENT_TASKINFO, data);
 
     return std::string("None");
 }
 
 void Stack::taskinfo(const std::string &zmq_url, const std::string &raw) {
-    std::string work_id = sample_json_str_get(raw, "work_id");
+    auto fields = sample_json_fields_get(raw, {"work_id", "object", "data"});
+    std::string work_id(fields[0]);
     try {
         auto_task_channel = get_channel(sample_get_work_id_num(work_id));
         task_channel->set_push_url(zmq_url);
@@ -206,7 +255,7 @@ void Stack::taskinfo(const std::string &zmq_url, const std::string &raw) {
 
     }
 
-    taskinfo(work_id, sample_json_str_get(raw, "object"), sample_json_str_get(raw, "data"));
+    taskinfo(work_id, std::string(fields[1]), std::string(fields[2]));
 }
 
 void StackFlow::taskinfo(const std::string &work_id, const std::string &object, const std::string &data) {
@@ -217,34 +266,181 @@ void StackFlow::taskinfo(const std::string &work_id, const std::string &object,
 }
 
 
+/**
+ * 解析 register_unit 的响应：[work_id 编号][output_url][inference_url]
+ * 调用失败或者 unit-manager 端口耗尽（编号为 -1）时返回 -1
+ */
+static int parse_register_reply(const std::shared_ptr<pzmq_data> &raw, std::string &out_port,
+                                std::string &inference_port) {
+    if (!raw) {
+        return -1;
+    }
+    int work_id_number;
+    try {
+        work_id_number = std::stoi(raw->get_param(0));
+    } catch (...) {
+        return -1;
+    }
+    out_port = raw->get_param(1);
+    inference_port = raw->get_param(2);
+
+    return work_id_number;
+}
+
 /**
  * 这个  sys_register_unit 函数的作用是向系统注册工作单元并创建通信通道
  * 向系统注册单元：通过RPC调用 sys 服务的  register_unit 方法
  * 获取通信端口：从返回结果中提取各种通信端口信息
  * 创建通信通道：基于获取的端口信息创建  llm_channel_obj 对象
- * 返回工作ID：返回分配的工作单元编号
+ * 返回工作ID：返回分配的工作单元编号，sys 不可用或者端口耗尽时返回 -1，不创建通道
  */
 int StackFlow::sys_register_unit(const std::string &unit_name) {
     int work_id_number;
-    std::string str_port;
     std::string out_port;
     std::string inference_port;
 
+    // 优先从预注册池里取，没有到 sys 的往返，也不用在这里绑定 PUB
+    if (warm_pool_ && (unit_name == unit_name_)) {
+        std::shared_ptr<llm_channel_obj> channel;
+        {
+            std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+            if (!warm_pool_->channels.empty()) {
+                work_id_number = warm_pool_->channels.front().first;
+                channel = std::move(warm_pool_->channels.front().second);
+                warm_pool_->channels.pop_front();
+                warm_pool_->hits++;
+            } else {
+                warm_pool_->misses++;
+            }
+        }
+        warm_pool_refill(warm_pool_, unit_name_);
+        if (channel) {
+            llm_task_channel_.set(work_id_number, std::move(channel));
+            return work_id_number;
+        }
+    }
+
+    // 响应为三个字段：[work_id 编号][output_url][inference_url]
+    // 池未命中也走这里，和预注册池用同一个 parse_register_reply：
+    // sys 不可用或者端口耗尽时不创建通道，返回 -1 由调用者给用户报错
+    work_id_number = -1;
     unit_call("sys", "register_unit", unit_name, [&](const std::shared_ptr<StackFlows::pzmq_data> &pzmg_msg)
     {
-        str_port = pzmg_msg->get_param(1);
-        inference_port = pzmg_msg->get_param(0, str_port);
-        out_port = pzmg_msg->get_param(1, str_port);
-        str_port = pzmg_msg->get_param(0);
+        work_id_number = parse_register_reply(pzmg_msg, out_port, inference_port);
     });
-    work_id_number = std::stoi(str_port);
+    if (work_id_number < 0) {
+        ALOGE("register unit %s failed", unit_name.c_str());
+        if (warm_pool_ && (unit_name == unit_name_)) {
+            std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+            warm_pool_->failed++;
+        }
+        return -1;
+    }
     ALOGI("work_id_number:%d, out_port:%s, inference_port:%s ", work_id_number, out_port.c_str(),
         inference_port.c_str());
-    llm_task_channel_[work_id_number] = std::make_shared<llm_channel_obj>(out_port, inference_port, unit_name_);
+    llm_task_channel_.set(work_id_number, std::make_shared<llm_channel_obj>(out_port, inference_port, unit_name_));
 
     return work_id_number;
 }
 
+/**
+ * 设置预注册池的大小并同步填满，启动阶段调用，不在 setup 的关键路径上
+ * 注册失败（sys 不可用、端口耗尽）时停止填充，之后每次 setup 取用时会在后台重试补充
+ */
+void StackFlow::set_warm_pool(int size) {
+    if (!warm_pool_) {
+        warm_pool_ = std::make_shared<warm_pool_state>();
+    }
+    {
+        std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+        warm_pool_->size = size;
+    }
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+            if (static_cast<int>(warm_pool_->channels.size()) + warm_pool_->inflight >= warm_pool_->size) {
+                break;
+            }
+        }
+        std::string out_port;
+        std::string inference_port;
+        int work_id_number = -1;
+        unit_call("sys", "register_unit", unit_name_, [&](const std::shared_ptr<pzmq_data> &raw) {
+            work_id_number = parse_register_reply(raw, out_port, inference_port);
+        });
+        if (work_id_number < 0) {
+            ALOGE("warm pool register %s failed", unit_name_.c_str());
+            std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+            warm_pool_->failed++;
+            break;
+        }
+        auto channel = std::make_shared<llm_channel_obj>(out_port, inference_port, unit_name_);
+        std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+        warm_pool_->channels.emplace_back(work_id_number, std::move(channel));
+    }
+}
+
+/**
+ * 后台补充预注册池：缺多少发多少个异步 register_unit，结果在异步客户端的 io 线程里放回池中
+ * 回调只持有池状态的 shared_ptr，不访问 StackFlow 对象；池已经关闭时把注册到的 work_id 还给 sys
+ */
+void StackFlow::warm_pool_refill(const std::shared_ptr<warm_pool_state> &state, const std::string &unit_name) {
+    int count;
+    {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        if (state->closed) {
+            return;
+        }
+        count = state->size - static_cast<int>(state->channels.size()) - state->inflight;
+        if (count <= 0) {
+            return;
+        }
+        state->inflight += count;
+    }
+    for (int i = 0; i < count; ++i) {
+        unit_call_async("sys", "register_unit", unit_name,
+            [state, unit_name](int ret, const std::shared_ptr<pzmq_data> &raw) {
+                std::string out_port;
+                std::string inference_port;
+                int work_id_number = (ret == 0) ? parse_register_reply(raw, out_port, inference_port) : -1;
+                std::shared_ptr<llm_channel_obj> channel;
+                if (work_id_number >= 0) {
+                    channel = std::make_shared<llm_channel_obj>(out_port, inference_port, unit_name);
+                }
+                std::unique_lock<std::mutex> lock(state->mtx);
+                state->inflight--;
+                if (work_id_number < 0) {
+                    state->failed++;
+                    return;
+                }
+                if (!state->closed) {
+                    state->channels.emplace_back(work_id_number, std::move(channel));
+                    return;
+                }
+                lock.unlock();
+                channel.reset();
+                unit_call_async("sys", "release_unit", sample_get_work_id(work_id_number, unit_name),
+                    [](int, const std::shared_ptr<pzmq_data> &) {});
+            });
+    }
+}
+
+std::string StackFlow::_rpc_warm_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
+    if (!warm_pool_) {
+        return std::string("{\"size\":0}");
+    }
+    std::unique_lock<std::mutex> lock(warm_pool_->mtx);
+    std::string out = "{\"size\":" + std::to_string(warm_pool_->size);
+    out += ",\"ready\":" + std::to_string(warm_pool_->channels.size());
+    out += ",\"inflight\":" + std::to_string(warm_pool_->inflight);
+    out += ",\"hits\":" + std::to_string(warm_pool_->hits);
+    out += ",\"misses\":" + std::to_string(warm_pool_->misses);
+    out += ",\"failed\":" + std::to_string(warm_pool_->failed);
+    out += "}";
+
+    return out;
+}
+
 /**
  * 这个函数确保工作单元在系统中被正确注销，避免资源泄漏。
  */
@@ -259,8 +455,7 @@ bool StackFlow::sys_release_unit(int work_id_num, const std::string &work_id) {
         _work_id_num = sample_get_work_id_num(work_id);
     }
     unit_call("sys", "release_unit", _work_id);
-    llm_task_channel_[_work_id_num].reset();
-    llm_task_channel_.erase(_work_id_num);
+    llm_task_channel_.take(_work_id_num); // 通道在表的锁外销毁，析构时会停止订阅线程
     ALOGI("release work_id %s success", _work_id.c_str());
 
     return false;
@@ -275,4 +470,75 @@ std::string sys_sql_set(const std::string &key, const std::string &val) {
 
 void StackFlow::sys_sql_unset(const std::string &key) {
     unit_call("sys", "sql_unset", key);
-}
\ No newline at end of file
+}
+
+namespace {
+
+std::mutex embed_mtx;
+
+std::unordered_map<std::string, StackFlows::stackflow_embed::factory> &embed_factories() {
+    static std::unordered_map<std::string, StackFlows::stackflow_embed::factory> factories;
+    return factories;
+}
+
+std::vector<std::unique_ptr<StackFlows::StackFlow>> &embed_units() {
+    static std::vector<std::unique_ptr<StackFlows::StackFlow>> units;
+    return units;
+}
+
+} // namespace
+
+/**
+ * 登记嵌入单元的创建函数，同名的后登记的覆盖先登记的
+ * 返回值只是为了让 STACKFLOW_EMBED_UNIT 能在静态初始化时调用
+ */
+int stackflow_embed::add(const std::string &unit_name, const factory &make) {
+    std::unique_lock<std::mutex> lock(embed_mtx);
+    embed_factories()[unit_name] = make;
+
+    return 0;
+}
+
+/**
+ * 创建一个已登记的单元，单元的构造函数会注册自己的 RPC 服务，
+ * 所以要在 unit-manager 的 sys RPC 服务起来之后再调用
+ * 返回值：成功返回 0，没有登记返回 -1
+ */
+int stackflow_embed::start(const std::string &unit_name) {
+    factory make;
+    {
+        std::unique_lock<std::mutex> lock(embed_mtx);
+        auto iteam = embed_factories().find(unit_name);
+        if (iteam == embed_factories().end()) {
+            return -1;
+        }
+        make = iteam->second;
+    }
+    std::unique_ptr<StackFlow> unit = make();
+    ALOGI("embedded unit %s start", unit_name.c_str());
+    std::unique_lock<std::mutex> lock(embed_mtx);
+    embed_units().push_back(std::move(unit));
+
+    return 0;
+}
+
+void stackflow_embed::stop_all() {
+    std::vector<std::unique_ptr<StackFlow>> units;
+    {
+        std::unique_lock<std::mutex> lock(embed_mtx);
+        units.swap(embed_units());
+    }
+    while (!units.empty()) {
+        units.pop_back();
+    }
+}
+
+std::vector<std::string> stackflow_embed::list() {
+    std::vector<std::string> names;
+    std::unique_lock<std::mutex> lock(embed_mtx);
+    for (auto &iteam : embed_factories()) {
+        names.push_back(iteam.first);
+    }
+
+    return names;
+}
@@ -1,6 +1,7 @@
 #include <vector>
 #include <glob.h>
 #include <fstream>
+#include <charconv>
 
 #include "StackFlowUtil.h"
 #include "pzmq.hpp"
@@ -11,18 +12,22 @@
 
 /**
  * 这个函数的作用是从JSON字符串中提取指定键的值
+ * json_str 是 string_view，可以直接传入 pzmq_data::view()，查找和遍历都不拷贝原始消息
  * 使用实例：
  * // JSON: {"action": "inference", "data": {"key": "value"}}
  * std::string action = sample_json_str_get(json_str, "action");  // 返回: inference
  * std::string data = sample_json_str_get(json_str, "data");      // 返回: {"key": "value"}
  */
-std::string StackFlows::sample_json_str_get(const std::string &json_str, const std::string &json_key) {
+std::string StackFlows::sample_json_str_get(std::string_view json_str, std::string_view json_key) {
     std::string key_val;
-    std::string format_val;
-    std::string find_key = "\"" + json_key + "\"";
+    std::string find_key;
+    find_key.reserve(json_key.length() + 2);
+    find_key += '"';
+    find_key += json_key;
+    find_key += '"';
     
-    int subs_start = json_str.find(find_key);
-    if (subs_start == std::string::npos) {
+    size_t subs_start = json_str.find(find_key);
+    if (subs_start == std::string_view::npos) {
         return key_val;
     }
 
@@ -92,28 +97,262 @@ std::string StackFlows::sample_json_str_get(const std::string &json_str, const s
     return key_val;
 }
 
+/**
+ * 单次扫描的 JSON 字段提取：
+ * sample_json_str_get 每取一个字段都要从头 find 一遍，一条消息取 k 个字段就是 O(k·n)
+ * 这里只在顶层对象上走一遍，遇到需要的键就记录它的值，取 k 个字段总共 O(n)
+ *
+ * 字符串内容用 memchr 跳到下一个引号（glibc 的 memchr 是向量化实现），
+ * 不再逐字符处理，只有遇到反斜杠转义时才回头检查
+ */
+namespace {
+
+const char *json_skip_ws(const char *pos, const char *end) {
+    while ((pos < end) && ((*pos == ' ') || (*pos == '\t') || (*pos == '\r') || (*pos == '\n'))) {
+        ++pos;
+    }
+    return pos;
+}
+
+// pos 指向开引号之后，返回闭引号的位置，没有闭引号时返回 end
+const char *json_scan_string(const char *pos, const char *end) {
+    const char *start = pos;
+    while (pos < end) {
+        const char *quote = static_cast<const char *>(memchr(pos, '"', end - pos));
+        if (quote == nullptr) {
+            return end;
+        }
+        const char *slash = quote;
+        while ((slash > start) && (slash[-1] == '\\')) {
+            --slash;
+        }
+        if (((quote - slash) & 1) == 0) {
+            return quote;
+        }
+        pos = quote + 1;
+    }
+    return end;
+}
+
+// pos 指向值的第一个字符，返回值结束后的位置，格式错误时返回 nullptr
+const char *json_scan_value(const char *pos, const char *end) {
+    if (*pos == '"') {
+        const char *quote = json_scan_string(pos + 1, end);
+        return (quote < end) ? quote + 1 : nullptr;
+    }
+    if ((*pos == '{') || (*pos == '[')) {
+        int depth = 0;
+        while (pos < end) {
+            switch (*pos) {
+                case '"': {
+                    pos = json_scan_string(pos + 1, end);
+                    if (pos == end) {
+                        return nullptr;
+                    }
+                } break;
+                case '{':
+                case '[':
+                    depth++;
+                    break;
+                case '}':
+                case ']': {
+                    if (--depth == 0) {
+                        return pos + 1;
+                    }
+                } break;
+                default:
+                    break;
+            }
+            ++pos;
+        }
+        return nullptr;
+    }
+    while ((pos < end) && (*pos != ',') && (*pos != '}') && (*pos != ']') && (*pos != ' ') && (*pos != '\t') &&
+           (*pos != '\r') && (*pos != '\n')) {
+        ++pos;
+    }
+    return pos;
+}
+
+} // namespace
+
+/**
+ * 从 json_str 的顶层对象中一次取出 keys[0..count) 对应的值，写入 values：
+ * 字符串值返回引号内的内容（与 sample_json_str_get 一致，不处理转义），
+ * 对象、数组和其它值返回原始文本；不存在的字段为空（data() == nullptr）
+ * 返回找到的字段数
+ */
+int StackFlows::sample_json_fields_get(std::string_view json_str, const std::string_view *keys,
+                                       std::string_view *values, int count) {
+    for (int i = 0; i < count; ++i) {
+        values[i] = std::string_view();
+    }
+    const char *pos = json_str.data();
+    const char *end = json_str.data() + json_str.size();
+    int found = 0;
+
+    pos = json_skip_ws(pos, end);
+    if ((pos == end) || (*pos != '{')) {
+        return found;
+    }
+    ++pos;
+    while (found < count) {
+        pos = json_skip_ws(pos, end);
+        if ((pos == end) || (*pos != '"')) {
+            break;
+        }
+        const char *key_end = json_scan_string(pos + 1, end);
+        if (key_end == end) {
+            break;
+        }
+        std::string_view key(pos + 1, key_end - pos - 1);
+        pos = json_skip_ws(key_end + 1, end);
+        if ((pos == end) || (*pos != ':')) {
+            break;
+        }
+        pos = json_skip_ws(pos + 1, end);
+        if (pos == end) {
+            break;
+        }
+        const char *value_start = pos;
+        pos = json_scan_value(pos, end);
+        if (pos == nullptr) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            if ((values[i].data() == nullptr) && (keys[i] == key)) {
+                if (*value_start == '"') {
+                    values[i] = std::string_view(value_start + 1, pos - value_start - 2);
+                } else {
+                    values[i] = std::string_view(value_start, pos - value_start);
+                }
+                found++;
+                break;
+            }
+        }
+        pos = json_skip_ws(pos, end);
+        if ((pos == end) || (*pos != ',')) {
+            break;
+        }
+        ++pos;
+    }
+    return found;
+}
+
+/**
+ * 流式输出每个 token 都要转义一次，按段追加不需要转义的连续字符，不逐字节 push_back
+ * sample_json_escape_append(out, "a\"b\n");  // out 追加: a\"b\n
+ */
+void StackFlows::sample_json_escape_append(std::string &out, std::string_view str) {
+    static const char hex[] = "0123456789abcdef";
+    size_t start = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if ((c >= 0x20) && (c != '"') && (c != '\\')) {
+            continue;
+        }
+        out.append(str.data() + start, i - start);
+        start = i + 1;
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\b':
+                out += "\\b";
+                break;
+            case '\f':
+                out += "\\f";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+                out.append(esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    out.append(str.data() + start, str.size() - start);
+}
+
+namespace {
+
+bool is_work_id_name_char(char c) {
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || (c == '_');
+}
+
+// 解析 "123"，要求以数字开头；full 为 true 时要求整个串都是数字
+bool parse_work_id_num(std::string_view str, bool full, int &num) {
+    if (str.empty() || (str[0] < '0') || (str[0] > '9')) {
+        return false;
+    }
+    auto ret = std::from_chars(str.data(), str.data() + str.size(), num);
+    if (ret.ec != std::errc()) {
+        return false;
+    }
+    return (!full) || (ret.ptr == str.data() + str.size());
+}
+
+} // namespace
+
+/**
+ * 严格解析 "单元名.编号"，等价于原来的 std::regex_match(work_id, std::regex(R"((\w+)\.(\d+))"))
+ * 手写扫描 + std::from_chars，不抛异常，name 指向 work_id 内部，格式不对时输出参数不变
+ * split_work_id("llm.1000", name, num);  // true, name == "llm", num == 1000
+ * split_work_id("llm", name, num);       // false
+ * split_work_id("llm.10a", name, num);   // false
+ */
+bool StackFlows::split_work_id(std::string_view work_id, std::string_view &name, int &num) {
+    size_t a = work_id.find('.');
+    if ((a == 0) || (a == std::string_view::npos)) {
+        return false;
+    }
+    for (size_t i = 0; i < a; ++i) {
+        if (!is_work_id_name_char(work_id[i])) {
+            return false;
+        }
+    }
+    int id_num;
+    if (!parse_work_id_num(work_id.substr(a + 1), true, id_num)) {
+        return false;
+    }
+    name = work_id.substr(0, a);
+    num  = id_num;
+    return true;
+}
+
 /**
  * 这个函数的作用是从work_id字符串中提取数字部分。
  * sample_get_work_id_num("task.123");    // 返回: 123
  * sample_get_work_id_num("worker.456");  // 返回: 456
  * sample_get_work_id_num("invalid");     // 返回: WORK_ID_NONE (-100)
  * sample_get_work_id_num("task.");       // 返回: WORK_ID_NONE (-100)
+ * sample_get_work_id_num("task.abc");    // 返回: WORK_ID_NONE (-100)
  */
-int StackFlows::sample_get_work_id_num(const std::string &work_id) {
-    int a = work_id.find(".");
-    if ((a == std::string::npos) || (a == work_id.length() - 1)) {
+int StackFlows::sample_get_work_id_num(std::string_view work_id) {
+    size_t a = work_id.find('.');
+    if (a == std::string_view::npos) {
         return WORK_ID_NONE;
     }
-    return std::stoi(work_id.substr(a + 1));
+    int num;
+    if (!parse_work_id_num(work_id.substr(a + 1), false, num)) {
+        return WORK_ID_NONE;
+    }
+    return num;
 }
 
-std::string StackFlows::sample_get_work_id_name(const std::string &work_id) {
-    int a = work_id.find(".");
-    if (a == std::string::npos) {
-        return work_id;
-    } else {
-        return work_id.substr(0, a);
-    }
+std::string StackFlows::sample_get_work_id_name(std::string_view work_id) {
+    return std::string(work_id.substr(0, work_id.find('.')));
 }
 
 std::string StackFlows::sample_get_work_id(int work_id_num, const std::string &unit_name) {
@@ -168,12 +407,13 @@ bool StackFlows::decode_stream(const std::string &in, std::string &out,
      * delta：当前片段的实际数据内容
      * 将数据片段存储到缓冲区的对应位置
      */
-    int index  =std::stoi(StackFlows::sample_json_str_get(in, "index")); 
-    std::string finish = StackFlows::sample_json_str_get(in, "finish");
-    stream_buff[index] = StackFlows::sample_json_str_get(in, "delta");
+    auto fields = StackFlows::sample_json_fields_get(in, {"index", "finish", "delta"});
+    int index  =std::stoi(std::string(fields[0]));
+    std::string_view finish = fields[1];
+    stream_buff[index] = std::string(fields[2]);
 
     // 流式传输结束，重组数据
-    if (finish.find("f") == std::string::npos) {
+    if (finish.find("f") == std::string_view::npos) {
         for (size_t i = 0; i < stream_buff.size(); ++i) {
             out += stream_buff.at(i);
         }
@@ -185,6 +425,8 @@ bool StackFlows::decode_stream(const std::string &in, std::string &out,
 
 /**
  *  unit_call 用于调用远程服务的指定方法并返回结果
+ *  pzmq 对象本身不持有连接，底层 REQ 套接字来自进程级的 pzmq_rpc_pool，
+ *  所以每次调用构造一个 _call 几乎没有开销
  */
 std::string StackFlows::unit_call(const std::string &unit_name, const std::string &unit_action, 
                  const std::string &data) {
@@ -210,6 +452,20 @@ void StackFlows::unit_call(const std::string &unit_name, const std::string &unit
         });
 }
 
+/**
+ *  unit_call_async 是 unit_call 的异步版本，立即返回，结果通过 callback(ret, data) 通知
+ *  多个 unit_call_async 可以同时在途，共用一个 DEALER 连接，不用等上一个调用的往返
+ *  注意：callback 在异步客户端的 io 线程中执行
+ */
+void StackFlows::unit_call_async(const std::string &unit_name, const std::string &unit_action,
+                const std::string &data,
+                std::function<void(int, const std::shared_ptr<StackFlows::pzmq_data> &)> callback) {
+    StackFlows::pzmq _call(unit_name);
+    if (_call.call_rpc_action_async(unit_action, data, callback) != 0) {
+        callback(-1, nullptr);
+    }
+}
+
 /**
  *  file_exists 用于判断指定路径的文件是否存在且可访问
  * 
@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "channel.h"
+#include "pzmq_push_cache.hpp"
 #include "sample_log.h"
 
 using namespace StackFlows;
@@ -40,59 +41,43 @@ void llm_channel_obj::subscriber_event_call(const std::function<void(const std::
                                             const std::shared_ptr<pzmq_data> &raw) {
     
     /**
-     * 将ZMQ消息数据转换为字符串格式
-     * raw是pzmq_data类型的智能指针，包含接收到的消息
+     * 直接在ZMQ消息上解析，不拷贝成字符串
+     * raw是pzmq_data类型的智能指针，包含接收到的消息，在本函数返回前一直有效
      */
-    auto _raw = raw->string();
+    std::string_view _raw = raw->view();
 
     /**
-     * 定义搜索目标
-     * 要在JSON中查找的字段名："action"（包含引号）
-     * 这是JSON格式中action字段的标识符
+     * 一次扫描取出所有需要的顶层字段，不再每个字段从头 find 一遍
+     * fields: [0]action [1]zmq_com [2]request_id [3]work_id [4]object [5]data
+     * 只有顶层带 action 的消息（用户的推理请求）才更新推送地址和请求 ID，
+     * 数据里转义的 \"action\" 不在顶层，不会被误判
      */
-    const char *user_inference_flage_str = "\"action\"";
-
-    /**
-     * 开始搜索
-     * 在消息字符串中查找"action"的位置
-     * 返回第一次出现的位置索引，如果没找到返回std::string::npos
-     */
-    std::size_t pos = _raw.find(user_inference_flage_str);
-    while (true) {
-        if (pos == std::string::npos) {
-            break;
-        } else if ((pos > 0) && (_raw[pos - 1] != '\\')) {
-            std::string zmq_com = sample_json_str_get(_raw, "zmq_com");
-
-            /**
-             * 检查并设置推送URL
-             * !zmq_com.empty() - 检查zmq_com字符串是否不为空
-             * 如果不为空，调用set_push_url(zmq_com)设置推送连接的URL
-             * 
-             * 具体作用
-             * zmq_com是从JSON消息中提取的ZMQ通信地址
-             * 这个地址用于建立PUSH-PULL模式的连接，向外部用户发送响应
-             * 只有当消息中包含有效的zmq_com字段时，才会设置推送URL
-             */
-            if (!zmq_com.empty()) {
-                set_push_url(zmq_com); // 设置外部用户通信的推送地址
-            }
-
-            /**
-             * 唯一标识：每个RPC请求的唯一标识符，每个RPC请求的唯一标识符
-             * work_id_ - 工作标识符，标识具体的工作任务或处理单元，跟踪任务的执行状态
-             * 
-             * 接收消息：从JSON中提取request_id和work_id
-             * 处理请求：使用这些ID进行业务逻辑处理
-             * 发送响应：在响应中包含相同的ID，确保客户端能正确匹配请求和响应
-             */
-            request_id_ = sample_json_str_get(_raw, "request_id");
-            work_id_ = sample_json_str_get(_raw, "work_id");
-            break;
+    auto fields = sample_json_fields_get(_raw, {"action", "zmq_com", "request_id", "work_id", "object", "data"});
+    if (fields[0].data() != nullptr) {
+        /**
+         * 检查并设置推送URL
+         * zmq_com是用户会话的ZMQ通信地址，用于建立PUSH-PULL模式的连接，向外部用户发送响应
+         * unit-manager 把它作为路由帧放在原始请求前面（raw->head()），
+         * 没有路由帧时兼容旧格式，从JSON的zmq_com字段中读取
+         */
+        std::string_view zmq_com = fields[1];
+        std::shared_ptr<pzmq_data> head = raw->head();
+        if (head) {
+            zmq_com = head->view();
+        }
+        if (!zmq_com.empty()) {
+            set_push_url(std::string(zmq_com)); // 设置外部用户通信的推送地址
         }
-        pos = _raw.find(user_inference_flage_str, pos + sizeof(user_inference_flage_str));
+
+        /**
+         * 唯一标识：每个RPC请求的唯一标识符
+         * work_id_ - 工作标识符，标识具体的工作任务或处理单元，跟踪任务的执行状态
+         * 发送响应：在响应中包含相同的ID，确保客户端能正确匹配请求和响应
+         */
+        request_id_ = std::string(fields[2]);
+        work_id_ = std::string(fields[3]);
     }
-    call(sample_json_str_get(_raw, "object"), sample_json_str_get(_raw, "data"));
+    call(std::string(fields[4]), std::string(fields[5]));
 }
 
 void message_handler(pzmq *zmq_obj, const std::shared_ptr<pzmq_data> &data) {
@@ -109,27 +94,24 @@ int llm_channel_obj::subscriber_work_id(const std::string &work_id,
 
     /**
      * 匹配格式：单词.数字（如task.123）
-     * 提取数字部分作为连接ID
-     */
-    std::regex pattern(R"((\w+)\.(\d+))");
-    std::smatch matches;
-
-    /**
+     * 提取数字部分作为连接ID，用 split_work_id 手写解析，不再每次构造 std::regex
+     *
      * 两种订阅模式
      * 1. 有效work_id：通过unit_call("sys", "sql_select", ...)查询实际URL
      * 2. 空或无效work_id：使用默认的inference_url_
      */
-    if ((!work_id.empty()) && std::regex_match(work_id, matches, pattern)) {
-        if (matches.size() == 3) {
-            id_num = std::stoi(matches[2].str());
-
-            std::string input_url_name = work_id + "out_port";
-            std::string input_url = unit_call("sys", "sql_select", input_url_name);
-            if (input_url.empty()) {
-                return -1;
-            }
-            subscriber_url = input_url;
+    std::string_view work_unit;
+    int work_num;
+    if (split_work_id(work_id, work_unit, work_num)) {
+        id_num = work_num;
+
+        // 与 sys_allocate_unit 写入的键一致："<work_id>.out_port"
+        std::string input_url_name = work_id + ".out_port";
+        std::string input_url = unit_call("sys", "sql_select", input_url_name);
+        if (input_url.empty()) {
+            return -1;
         }
+        subscriber_url = input_url;
     } else {
         id_num = 0;
         subscriber_url = inference_url_;
@@ -148,15 +130,11 @@ int llm_channel_obj::subscriber_work_id(const std::string &work_id,
 }
 
 void llm_channel_obj::stop_subscriber_work_id(const std::string &work_id) {
-    int id_num;
-    std::regex pattern(R"((\w+)\.(\d+))");
-    std::smatch matches;
-    if (std::regex_match(work_id, matches, pattern)) {
-        if (matches.size() == 3) {
-            id_num = std::stoi(matches[2].str());
-        }
-    } else {
-        id_num = 0;
+    int id_num = 0;
+    std::string_view work_unit;
+    int work_num;
+    if (split_work_id(work_id, work_unit, work_num)) {
+        id_num = work_num;
     }
 
     if (zmq_.find(id_num) != zmq_end()) {
@@ -184,7 +162,19 @@ int llm_channel_obj::send_raw_to_pub(const std::string &raw) {
 }
 
 int llm_channel_obj::send_raw_to_usr(const std::string &raw) {
-    if (zmq_[-1]) {
+    if (zmq_[-2]) {
+        return zmq_[-2]->send_data(raw);
+    } else {
+        return -1;
+    }
+}
+
+int llm_channel_obj::send_raw_to_pub(const std::shared_ptr<const std::string> &raw) {
+    return zmq_[-1]->send_data(raw);
+}
+
+int llm_channel_obj::send_raw_to_usr(const std::shared_ptr<const std::string> &raw) {
+    if (zmq_[-2]) {
         return zmq_[-2]->send_data(raw);
     } else {
         return -1;
@@ -202,7 +192,60 @@ void llm_channel_obj::cear_push_url() {
     zmq_[-2].reset();
 }
 
+/**
+ * nlohmann::json 的对象按键名排序输出，这里按同样的顺序拼接，输出和 send() 逐字节一致：
+ * {"created":...,"data":{"delta":"...","finish":...,"index":...}  <- 每个片段拼接
+ * ,"error":{"code":0,"message":""},"object":"...","request_id":"...","work_id":"..."}\n  <- stream_tail_
+ */
+void llm_channel_obj::render_stream_tail(const std::string &object, const std::string &work_id) {
+    stream_object_     = object;
+    stream_request_id_ = request_id_;
+    stream_work_id_    = work_id;
+
+    stream_tail_.clear();
+    stream_tail_ += "},\"error\":{\"code\":0,\"message\":\"\"},\"object\":\"";
+    sample_json_escape_append(stream_tail_, stream_object_);
+    stream_tail_ += "\",\"request_id\":\"";
+    sample_json_escape_append(stream_tail_, stream_request_id_);
+    stream_tail_ += "\",\"work_id\":\"";
+    sample_json_escape_append(stream_tail_, stream_work_id_);
+    stream_tail_ += "\"}\n";
+}
+
+int llm_channel_obj::send_stream(const std::string &object, std::string_view delta, int index, bool finish,
+                                 const std::string &work_id) {
+    std::lock_guard<std::mutex> lock(stream_mtx_);
+    const std::string &out_work_id = work_id.empty() ? work_id_ : work_id;
+    if ((stream_tail_.empty()) || (stream_object_ != object) || (stream_request_id_ != request_id_) ||
+        (stream_work_id_ != out_work_id)) {
+        render_stream_tail(object, out_work_id);
+    }
+    time_t now = time(NULL);
+    if ((now != stream_time_) || (stream_created_.empty())) {
+        stream_time_    = now;
+        stream_created_ = std::to_string(now);
+    }
+
+    // clear() 不释放容量，缓冲区涨到最大的片段之后就不再分配
+    stream_buff_.clear();
+    stream_buff_ += "{\"created\":";
+    stream_buff_ += stream_created_;
+    stream_buff_ += ",\"data\":{\"delta\":\"";
+    sample_json_escape_append(stream_buff_, delta);
+    stream_buff_ += finish ? "\",\"finish\":true,\"index\":" : "\",\"finish\":false,\"index\":";
+    char index_str[16];
+    int index_len = snprintf(index_str, sizeof(index_str), "%d", index);
+    stream_buff_.append(index_str, index_len);
+    stream_buff_ += stream_tail_;
+
+    // token 片段通常远小于 pzmq::zero_copy_threshold，直接拷贝进 ZMQ 消息，缓冲区马上可以复用
+    send_raw_to_pub(stream_buff_);
+    if (enoutput_) {
+        return send_raw_to_usr(stream_buff_);
+    }
+    return 0;
+}
+
 int llm_channel_obj::send_raw_for_url(const std::string &zmq_url, const std::string &raw) {
-    pzmq _zmq(zmq_url, ZMQ_PUSH);
-    return _zmq.send_data(raw);
+    return pzmq_push_cache::instance().send(zmq_url, raw);
 }
\ No newline at end of file
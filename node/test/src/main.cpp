@@ -135,15 +135,9 @@ public:
          */
         if (llm_channel->enstream_) {
             static int count = 0;
-            nlohmann::json data_body;
-            data_body["index"] = count++;
-            data_body["delta"] = data;
-            if (!finish) {
-                data_body["delta"] = data;
-            } else {
-                data_body["delta"] = std::string("");
-            }
-            data_body["finish"] = finish;
+            // 每个 token 都走这里，用预渲染的信封输出，不再构造 nlohmann::json
+            llm_channel->send_stream(llm_task_obj->response_format_, finish ? std::string_view() : data, count++,
+                                     finish);
             if (finish) {
                 count = 0;
             }
@@ -264,7 +258,8 @@ public:
         int work_id_num = sample_get_work_id_num(work_id);
         if (WORK_ID_NONE == work_id_num) {
             std::vector<std::string> task_list;
-            std::transform(llm_task_channel_.begin(), llm_task_channel_.end(), std::bak_inserter(task_list),
+            auto task_channels = llm_task_channel_.snapshot();
+            std::transform(task_channels.begin(), task_channels.end(), std::bak_inserter(task_list),
                             [](cons auto task_Channel){
                                 return task_channel.second->work_id_;
                             });
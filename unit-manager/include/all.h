@@ -1,62 +1,45 @@
 #pragma once
 
-#include <pthread.h>
 #include <map>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <stdexcept>
 #include <utility>
-#include <any>
 #include <unordered_map>
 
 #include "sample_log.h"
+#include "key_store.h"
 
 /**
- * . 线程安全的键值存储系统
- * key_sql: 全局的键值存储容器，使用 std::any 支持任意类型值
- * key_sql_lock: 自旋锁，保护并发访问
+ * 线程安全的键值存储系统
+ * key_sql: 全局的分片键值存储，值的类型见 key_store
  */
-extern std::unordered_map<std::string, std::any> key_sql;
-extern pthread_spinlock_t key_sql_lock;
+extern key_store key_sql;
 
-// 三个线程安全宏
+// 三个线程安全宏，保留原来的调用方式
 // 安全读取
-#define SAFE_READING(_val, _type, _key) \
-    do { \
-        pthread_spin_lock(&key_sql_lock); \
-        try { \
-            _val = std::any_cast<_type>(key_sql.at(_key)); \
-        } catch (...) {} \
-        pthread_spin_unlock(&key_sql_lock); \
-    } while (0)
+#define SAFE_READING(_val, _type, _key) key_sql.get<_type>(_key, _val)
 
 // 安全设置
-#define SAFE_SETTING(_key, _val) \
-    do { \
-        pthread_spin_lock(&key_sql_lock); \
-        try { \
-            key_sql[_key] = _val; \
-        } catch (...) {} \
-        pthread_spin_unlock(&key_sql_lock); \
-    } while (0)
+#define SAFE_SETTING(_key, _val) key_sql.set(_key, _val)
 
 // 安全删除
-#define SAFE_ERASE(_key) \
-    do { \
-        pthread_spin_lock(&key_sql_lock); \
-        try { \
-            key_sql.erase(_key); \
-        } catch (...) {} \
-        pthread_spin_unlock(&key_sql_lock); \
-    } while (0)
+#define SAFE_ERASE(_key) key_sql.erase(_key)
+
+struct json_parse_ctx;
 
 /**
  * 单元管理接口
  * load_default_config(): 加载默认配置
  * unit_action_match(): 根据通信ID和JSON字符串匹配单元动作
+ *                      ctx 是调用者（TCP 会话）持有的解析上下文，不传时使用线程私有的上下文
+ * tcp_loop_stats(): TCP I/O 事件循环的连接统计（JSON）
  */
 void load_default_config();
-void unit_action_match(int com_id, const std::string &json_str);
+void unit_action_match(int com_id, std::string_view json_str);
+void unit_action_match(int com_id, std::string_view json_str, json_parse_ctx &ctx);
+std::string tcp_loop_stats();
 
 /**
  * 全局配置变量
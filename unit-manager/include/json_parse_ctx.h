@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <simdjson.h>
+
+/**
+ * json_parse_ctx 是可复用的 simdjson 解析上下文：
+ *
+ * 背景：
+ * unit_action_match 原来用一个全局 parser，外面套一把全局锁，所有 TCP I/O 线程的请求都串行解析；
+ * remote_call 每个请求还要再 new 一个 parser 和一份 padded_string 拷贝
+ *
+ * 设计：
+ * 1. 每个 TCP 会话（zmq_bus_com）持有一份，会话只在自己的事件循环线程里收消息，不需要加锁
+ * 2. buffer 只增不减，load() 把请求拷贝进去并留出 SIMDJSON_PADDING，稳定后不再分配内存
+ * 3. parser 内部的结构缓冲区同样随请求复用
+ *
+ * 注意：parser.iterate() 返回的文档在下一次 load() 之前有效
+ */
+struct json_parse_ctx {
+    simdjson::ondemand::parser parser;
+    std::string buffer;
+
+    simdjson::padded_string_view load(std::string_view json) {
+        if (buffer.size() < json.size() + simdjson::SIMDJSON_PADDING) {
+            buffer.resize(json.size() + simdjson::SIMDJSON_PADDING);
+        }
+        memcpy(buffer.data(), json.data(), json.size());
+        return simdjson::padded_string_view(buffer.data(), json.size(), buffer.size());
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+class unit_data;
+
+/**
+ * key_store 是 unit-manager 的全局键值存储：
+ *
+ * 背景：
+ * 原来的 key_sql 是一个 std::unordered_map<std::string, std::any>，整张表由一把自旋锁保护，
+ * sql_select、单元注册和配置读取都在这把锁上自旋，每次访问还要 std::any_cast
+ *
+ * 设计：
+ * 1. 分片：按 key 的哈希分到 shard_count 个分片，不同 key 的访问大多落在不同分片上
+ * 2. 读多写少：每个分片一把 shared_mutex，读取只加共享锁，多个会话可以同时查询
+ * 3. 类型固定：值是 std::variant，只有三种槽位：
+ *    int（数字配置）、std::string（URL、字符串配置、sql_set 的值）、std::shared_ptr<unit_data>（单元记录）
+ *    类型不匹配时和原来 any_cast 失败一样，读取不修改输出参数
+ * 4. 单元记录用 shared_ptr 保存，get() 返回引用计数的拷贝：TCP I/O 线程拿到单元后正在发送时，
+ *    另一个 sys 线程释放同一个单元只是去掉表里的引用，单元在最后一个使用者放手后才析构
+ */
+class key_store {
+public:
+    using value_type = std::variant<int, std::string, std::shared_ptr<unit_data>>;
+    static constexpr size_t shard_count = 16;
+
+private:
+    struct shard {
+        mutable std::shared_mutex mtx;
+        std::unordered_map<std::string, value_type> map;
+    };
+
+    std::array<shard, shard_count> shards_;
+
+    shard &get_shard(const std::string &key) {
+        return shards_[std::hash<std::string>{}(key) % shard_count];
+    }
+
+    const shard &get_shard(const std::string &key) const {
+        return shards_[std::hash<std::string>{}(key) % shard_count];
+    }
+
+public:
+    /**
+     * 读取 key 对应的 T 类型的值到 out，key 不存在或类型不符时返回 false，out 不变
+     */
+    template <typename T, typename V>
+    bool get(const std::string &key, V &out) const {
+        const shard &s = get_shard(key);
+        std::shared_lock<std::shared_mutex> lock(s.mtx);
+        auto iteam = s.map.find(key);
+        if (iteam == s.map.end()) {
+            return false;
+        }
+        const T *val = std::get_if<T>(&iteam->second);
+        if (val == nullptr) {
+            return false;
+        }
+        out = *val;
+        return true;
+    }
+
+    template <typename T>
+    void set(const std::string &key, T &&val) {
+        shard &s = get_shard(key);
+        std::unique_lock<std::shared_mutex> lock(s.mtx);
+        s.map[key] = std::forward<T>(val);
+    }
+
+    bool erase(const std::string &key) {
+        shard &s = get_shard(key);
+        std::unique_lock<std::shared_mutex> lock(s.mtx);
+        return s.map.erase(key) > 0;
+    }
+
+    /**
+     * 读取并删除，两步在同一把锁内完成：
+     * 同一个单元被并发释放两次时，只有一个调用者能拿到单元记录，端口不会重复归还
+     */
+    template <typename T, typename V>
+    bool take(const std::string &key, V &out) {
+        shard &s = get_shard(key);
+        std::unique_lock<std::shared_mutex> lock(s.mtx);
+        auto iteam = s.map.find(key);
+        if (iteam == s.map.end()) {
+            return false;
+        }
+        T *val = std::get_if<T>(&iteam->second);
+        if (val == nullptr) {
+            return false;
+        }
+        out = std::move(*val);
+        s.map.erase(iteam);
+        return true;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+ * mpsc_queue 是无锁的多生产者单消费者队列（Vyukov 链表队列）：
+ * 1. push() 只有一次原子交换，任意多个线程（TCP I/O 线程）可以同时入队，互不阻塞
+ * 2. pop() 只能由一个线程（单元的发送线程）调用
+ * 3. 队列本身不限长度，上限由使用者通过 size() 控制
+ */
+template <typename T>
+class mpsc_queue {
+private:
+    struct node {
+        std::atomic<node *> next;
+        T value;
+        node() : next(nullptr) {
+        }
+        explicit node(T &&val) : next(nullptr), value(std::move(val)) {
+        }
+    };
+
+    std::atomic<node *> tail_;
+    node *head_; // 哨兵节点，只由消费者访问
+    std::atomic<long> size_;
+
+public:
+    mpsc_queue() : size_(0) {
+        head_ = new node();
+        tail_.store(head_);
+    }
+
+    mpsc_queue(const mpsc_queue &) = delete;
+    mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+    void push(T &&val) {
+        node *n = new node(std::move(val));
+        size_.fetch_add(1);
+        node *prev = tail_.exchange(n);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    /**
+     * 取出队首元素，队列为空（或生产者还没有完成链接）时返回 false
+     */
+    bool pop(T &out) {
+        node *next = head_->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        out = std::move(next->value);
+        delete head_;
+        head_ = next;
+        size_.fetch_sub(1);
+        return true;
+    }
+
+    bool empty() const {
+        return size_.load() == 0;
+    }
+
+    long size() const {
+        return size_.load();
+    }
+
+    ~mpsc_queue() {
+        T val;
+        while (pop(val)) {
+        }
+        delete head_;
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * port_allocator 是单元端口分配器：
+ *
+ * 背景：
+ * sys_allocate_unit 原来每次注册都从头线性扫描 std::vector<bool> port_list 找空闲端口，
+ * 释放时再用 sscanf 按 zmq_s_format 从 URL 里反解出端口号
+ *
+ * 设计：
+ * 1. 位图：每个端口一位，1 表示已占用，按 64 位字存储
+ * 2. 查找第一个空闲端口：跳过全 1 的字，在第一个有空位的字上用 __builtin_ctzll(~word) 一条指令定位
+ * 3. hint_ 记录可能有空位的最小字下标，分配从 hint_ 开始，释放时回退 hint_，
+ *    反复注册/释放时每次只看一两个字，与配置的端口数量无关
+ * 4. 分配出的端口号直接保存在 unit_data 里，释放时不需要再解析 URL
+ * 5. 统计：当前占用数、峰值、分配/释放次数、端口耗尽次数，可在任意线程读取
+ */
+class port_allocator {
+private:
+    std::mutex mtx_;
+    std::vector<uint64_t> words_;
+    int min_port_;
+    int capacity_;
+    size_t hint_;
+    std::atomic<int> used_;
+    std::atomic<int> peak_;
+    std::atomic<uint64_t> allocated_;
+    std::atomic<uint64_t> released_;
+    std::atomic<uint64_t> exhausted_;
+
+public:
+    port_allocator()
+        : min_port_(0), capacity_(0), hint_(0), used_(0), peak_(0), allocated_(0), released_(0), exhausted_(0) {
+    }
+
+    /**
+     * 管理 [min_port, max_port) 范围内的端口，最后一个字中超出范围的位预先置 1，永远不会被分配
+     */
+    void init(int min_port, int max_port) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        min_port_ = min_port;
+        capacity_ = (max_port > min_port) ? (max_port - min_port) : 0;
+        words_.assign((capacity_ + 63) / 64, 0);
+        if (capacity_ % 64) {
+            words_.back() = ~0ULL << (capacity_ % 64);
+        }
+        hint_ = 0;
+        used_ = 0;
+    }
+
+    /**
+     * 分配一个空闲端口，端口耗尽时返回 -1
+     */
+    int allocate() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        for (size_t i = hint_; i < words_.size(); ++i) {
+            if (words_[i] == ~0ULL) {
+                continue;
+            }
+            int bit = __builtin_ctzll(~words_[i]);
+            words_[i] |= 1ULL << bit;
+            hint_ = i;
+            lock.unlock();
+            int used = ++used_;
+            int peak = peak_.load();
+            while ((used > peak) && !peak_.compare_exchange_weak(peak, used)) {
+            }
+            allocated_++;
+            return min_port_ + static_cast<int>(i * 64) + bit;
+        }
+        hint_ = words_.size();
+        lock.unlock();
+        exhausted_++;
+        return -1;
+    }
+
+    /**
+     * 归还端口，不在范围内或本来就空闲的端口返回 false
+     */
+    bool release(int port) {
+        int index = port - min_port_;
+        if ((index < 0) || (index >= capacity_)) {
+            return false;
+        }
+        size_t word = index / 64;
+        uint64_t mask = 1ULL << (index % 64);
+        std::unique_lock<std::mutex> lock(mtx_);
+        if ((words_[word] & mask) == 0) {
+            return false;
+        }
+        words_[word] &= ~mask;
+        if (word < hint_) {
+            hint_ = word;
+        }
+        lock.unlock();
+        used_--;
+        released_++;
+        return true;
+    }
+
+    int capacity() const {
+        return capacity_;
+    }
+
+    int used() const {
+        return used_.load();
+    }
+
+    int peak() const {
+        return peak_.load();
+    }
+
+    uint64_t allocated() const {
+        return allocated_.load();
+    }
+
+    uint64_t released() const {
+        return released_.load();
+    }
+
+    uint64_t exhausted() const {
+        return exhausted_.load();
+    }
+};
@@ -1,4 +1,8 @@
 #pragma once
 
 #include <string>
-int remote_call(int comd_id, const std::string &json_str);
\ No newline at end of file
+#include <string_view>
+
+int remote_call(int comd_id, const std::string &json_str);
+int remote_call(int com_id, const std::string &request_id, const std::string &work_id,
+                const std::string &action, std::string_view json_str);
@@ -16,4 +16,6 @@
 using namespace StackFlows;
 
 void remote_server_work();
-void remote_server_stop_work();
\ No newline at end of file
+void remote_server_stop_work();
+void usr_print_error(const std::string &request_id, const std::string &work_id,
+                    const std::string &error_msg, int zmq_out);
\ No newline at end of file
@@ -2,23 +2,71 @@
 
 #include <any>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
 
 #include "network/TcpServer.h"
 #include "netwrok/EventLoop.h"
 #include "zmq_bus.h"
 #include "network/TcpConnection.h"
 
-class TcpSession : public zmq_bus_com {
+/**
+ * TcpSession 把单元的响应写回 TCP 连接：
+ *
+ * 背景：
+ * send_data 在 pzmq 的 PULL 线程里调用，原来每条响应都要 printf 整个负载、new 一个 network::Buffer
+ * 再跨线程 conn_->send，流式输出时每个 token 都是一次堆分配加一次跨线程投递
+ *
+ * 设计：
+ * 1. PULL 线程只把数据追加到 pending_，只有 pending_ 从空变为非空时才向连接的事件循环投递一次 flush
+ * 2. flush 在连接自己的事件循环线程里执行：交换出 pending_，用一次 send 写出所有积攒的响应，
+ *    同一轮事件循环里到达的多个 token 合并成一次写
+ * 3. pending_ 和 flushing_ 两块缓冲区交替使用，容量保留，稳定后不再分配内存
+ */
+class TcpSession : public zmq_bus_com, public std::enable_shared_from_this<TcpSession> {
 public:
     explicit TcpSession(const network::TcpConnectionPtr &conn)
-        : conn_(conn) {}
+        : conn_(conn), flush_scheduled_(false) {}
     
-    void send_data(const std::string &data) override {
-        printf("zmq_bus_com::send_data : send: %s\n", data.c_srt());
-        network::Buffer *buf = new network::Buffer;
-        buf->append(data.c_str(), data.size());
-        conn_->send(buf);
+    void send_data(std::string_view data) override {
+        bool schedule = false;
+        {
+            std::unique_lock<std::mutex> lock(pending_mtx_);
+            pending_.append(data.data(), data.size());
+            if (!flush_scheduled_) {
+                flush_scheduled_ = true;
+                schedule = true;
+            }
+        }
+        if (schedule) {
+            std::weak_ptr<TcpSession> weak_self = shared_from_this();
+            conn_->getLoop()->queueInLoop([weak_self]() {
+                auto self = weak_self.lock();
+                if (self) {
+                    self->flush();
+                }
+            });
+        }
     }
 
     network::TcpConnectionPtr conn_;
-};
\ No newline at end of file
+
+private:
+    std::mutex pending_mtx_;
+    std::string pending_;
+    bool flush_scheduled_;
+    std::string flushing_; // 只在连接的事件循环线程里使用
+
+    void flush() {
+        {
+            std::unique_lock<std::mutex> lock(pending_mtx_);
+            pending_.swap(flushing_);
+            flush_scheduled_ = false;
+        }
+        if (!flushing_.empty() && conn_->connected()) {
+            conn_->send(flushing_.data(), static_cast<int>(flushing_.size()));
+        }
+        flushing_.clear();
+    }
+};
@@ -1,22 +1,70 @@
 #pragma once 
 
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <string_view>
 #include "pzmq.hpp"
+#include "mpsc_queue.h"
 
 using namespace StackFlows;
 
+/**
+ * unit_data 是 unit-manager 里一个工作单元的记录，持有把用户 inference 请求发布给单元的 PUB 套接字
+ *
+ * 发布队列：
+ * send_msg() 不直接在 TCP I/O 线程里发送，而是放进单元自己的无锁 MPSC 队列，
+ * 由单元的发送线程批量取出后依次发送，一个客户端的突发请求不会卡住网络事件循环
+ * 队列长度超过高水位 queue_hwm_ 时按 queue_policy_ 处理：
+ * QUEUE_DROP_NEW：拒绝新消息，send_msg() 返回 -1，用户收到 inference data push false
+ * QUEUE_DROP_OLD：新消息照常入队，发送线程丢弃最旧的消息直到回到高水位以下
+ */
 class unit_data {
+public:
+    enum {
+        QUEUE_DROP_NEW = 0,
+        QUEUE_DROP_OLD,
+    };
+
 private:
+    // 一条消息只分配一次：head 和 body 拼在同一个引用计数的数据块里，body 由 pzmq 零拷贝发送
+    struct publish_msg {
+        std::shared_ptr<const std::string> blob;
+        size_t head_len; // 为 0 时按单帧发送
+    };
+
     std::unique_ptr<pzmq> user_inference_chennal_;
+    mpsc_queue<publish_msg> queue_;
+    int queue_hwm_;
+    int queue_policy_;
+    int sender_fd_;
+    std::atomic<bool> sender_sleep_;
+    std::atomic<bool> sender_exit_;
+    std::unique_ptr<std::thread> sender_thread_;
+    std::atomic<uint64_t> sent_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> batches_;
+
+    int enqueue(publish_msg &&msg);
+    void sender_loop();
 
 public:
     std::string work_id;
     std::string output_url;
     std::string inference_url;
     int port_;
+    int output_port_;    // 由 port_allocator 分配，释放单元时归还
+    int inference_port_;
 
     unit_data();
     void init_zmq(const std::string &url);
-    void send_msg(const std::string &json_str);
+    int send_msg(const std::string &json_str);
+    int send_msg(std::string_view zmq_com, std::string_view json_str);
+
+    // 发布队列统计，可在任意线程读取
+    long queue_depth() const;
+    uint64_t sent() const;
+    uint64_t dropped() const;
+    uint64_t batches() const;
     ~unit_data();
-};
\ No newline at end of file
+};
@@ -1,30 +1,61 @@
 #pragma once
 
 #include <vector>
+#include <string_view>
 #include "pzmq.hpp"
 #include "unit_data.h"
+#include "json_parse_ctx.h"
 
 using namespace StackFlows;
 
-int zmq_bus_publisher_push(const std::string &work_id, const std::string &json_str);
+int zmq_bus_publisher_push(const std::string &work_id, std::string_view zmq_com, std::string_view json_str);
 void zmq_com_send(int com_id, const std::string &out_str);
 
+/**
+ * zmq_bus_com 是一个 TCP 会话在 unit-manager 里的总线端点：
+ * 用户请求从 TCP 进来，经 feed() 分帧后逐个交给 on_data() 分发；
+ * 单元的响应从会话自己的 PULL 套接字回来，经 send_data() 写回 TCP
+ *
+ * 分帧（feed）：
+ * TCP 是字节流，一个分段里可能有多条请求（客户端流水线发送），一条请求也可能被拆到多个分段里
+ * feed() 直接在接收缓冲区上找完整的帧，每找到一帧就分发一次，返回已经消费的字节数，
+ * 不完整的尾部留在缓冲区里等下一个分段，整个过程不拷贝数据
+ * 两种帧格式，由连接的第一个字节决定：
+ * 1. FRAME_LINE：JSON 文本（默认），顶层的对象/数组括号闭合时即为一帧，不要求以换行结尾，
+ *    对象内部的换行（多行缩进的 JSON）不会把它切开；括号外的换行也结束一帧（兼容换行分隔的请求），
+ *    帧两端的空白和空行会被忽略；不是对象/数组的内容必须以换行结尾，否则一直等到超过 max_frame_size_
+ * 2. FRAME_LENGTH：[4 字节大端长度][负载]，第一个字节为 0 时使用（JSON 不会以 0 开头）
+ * 单帧超过 max_frame_size_ 视为协议错误，feed() 返回 -1，调用者应关闭连接
+ */
 class zmq_bus_com {
+public:
+    enum {
+        FRAME_AUTO = 0,
+        FRAME_LINE,
+        FRAME_LENGTH,
+    };
+
 protected:
     std::string _zmq_url;
     int exit_flage;
     int err_count;
     int _port;
-    std::string json_str;
-    int json_str_flage_;
+    int frame_mode_;
+    size_t max_frame_size_;
+    // FRAME_LINE 的扫描状态：未消费的尾部已经扫描过的字节数、括号深度、是否在字符串里
+    size_t line_scanned_;
+    int json_depth_;
+    bool json_in_string_;
+    bool json_escape_;
+    json_parse_ctx json_ctx_; // 本会话专用的 JSON 解析上下文，只在会话的 I/O 线程里使用
 
 public:
     std::unique_ptr<pzmq> user_chennal_;
     zmq_bus_com();
     void work(const std::string &zmq_url_format, int port);
     void stop();
-    void select_json_str(const std::string &json_src, std::function<void(const std::string &)> out_fun);
-    virtual void on_data(const std::string &data);
-    virtual void send_data(const std::string &data);
+    long feed(const char *data, size_t len);
+    virtual void on_data(std::string_view data);
+    virtual void send_data(std::string_view data);
     ~zmq_bus_com();
 };
\ No newline at end of file
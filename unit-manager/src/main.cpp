@@ -11,21 +11,14 @@
 #include "remote_action.h"
 #include "remote_server.h"
 #include "unit_data.h"
+#include "pzmq_context.hpp"
+#include "pzmq_reactor.hpp"
+#include "StackFlow.h"
 
 /**
- * 这是一个自旋锁（spinlock）。
- * pthread_spinlock_t 是 POSIX 线程库提供的自旋锁类型，特点是：
- * 忙等待 - 线程不会阻塞，而是持续检查锁状态
- * 低延迟 - 适合短时间持有的锁，避免线程切换开销
- * 高CPU消耗 - 等待期间会消耗CPU资源
- * 
- * 在all.h文件中：
- * 在这个代码中，key_sql_lock 
- * 用于保护全局键值存储容器 key_sql 的并发访问，
- * 配合三个线程安全宏使用
+ * 全局键值存储，按 key 分片，每个分片一把读写锁，见 key_store.h
  */
-pthread_spinlock_t key_sql_lock
-std::unordered_map<std::string, std::ant> key_sql;
+key_store key_sql;
 std::string zmq_s_format;
 std::string zmq_c_format;
 int main_exit_flage = 0;
@@ -38,15 +31,71 @@ void tcp_work();
 
 void tcp_stop_work();
 
+/**
+ * 创建嵌入的单元：config_embedded_units 是逗号分隔的单元名，为空时创建所有已登记的单元
+ * 单元的构造函数要调用 sys RPC，所以放在 remote_server_work() 之后
+ */
+void embedded_units_work() {
+    std::string embedded_units;
+    SAFE_READING(embedded_units, std::string, "config_embedded_units");
+    std::vector<std::string> names;
+    if (embedded_units.empty()) {
+        names = StackFlows::stackflow_embed::list();
+    } else {
+        size_t begin = 0;
+        while (begin <= embedded_units.length()) {
+            size_t end = embedded_units.find(',', begin);
+            if (end == std::string::npos) {
+                end = embedded_units.length();
+            }
+            if (end > begin) {
+                names.push_back(embedded_units.substr(begin, end - begin));
+            }
+            begin = end + 1;
+        }
+    }
+    for (auto &name : names) {
+        if (StackFlows::stackflow_embed::start(name) != 0) {
+            ALOGE("embedded unit %s not registered", name.c_str());
+        }
+    }
+}
+
 void all_work() {
-    zmq_s_format = std::any_cast<std::string>(key_sql["config_zmq_s_format"]);
-    zmq_c_format = std::any_cast<std::string>(key_sql["config_zmq_c_format"]);
+    SAFE_READING(zmq_s_format, std::string, "config_zmq_s_format");
+    SAFE_READING(zmq_c_format, std::string, "config_zmq_c_format");
+
+    // 共享 ZMQ 上下文的参数，必须在创建第一个 pzmq 对象之前设置
+    int zmq_io_threads = 0;
+    int zmq_max_sockets = 0;
+    SAFE_READING(zmq_io_threads, int, "config_zmq_io_threads");
+    SAFE_READING(zmq_max_sockets, int, "config_zmq_max_sockets");
+    StackFlows::pzmq_context::instance().set_io_threads(zmq_io_threads);
+    StackFlows::pzmq_context::instance().set_max_sockets(zmq_max_sockets);
+
+    // 嵌入模式：单元运行在本进程里，ipc:// 地址全部改写成 inproc://
+    int zmq_embedded = 0;
+    SAFE_READING(zmq_embedded, int, "config_zmq_embedded");
+    StackFlows::pzmq_context::instance().set_inproc(zmq_embedded != 0);
+
+    // 接收反应器：SUB/PULL/REP 套接字共用一个轮询线程和一组工作线程，不再每个套接字一个线程
+    int zmq_reactor = 0;
+    int zmq_reactor_workers = 0;
+    SAFE_READING(zmq_reactor, int, "config_zmq_reactor");
+    SAFE_READING(zmq_reactor_workers, int, "config_zmq_reactor_workers");
+    StackFlows::pzmq_reactor::set_enabled(zmq_reactor != 0);
+    StackFlows::pzmq_reactor::instance().set_workers(zmq_reactor_workers);
+
     remote_server_work();
+    if (zmq_embedded) {
+        embedded_units_work();
+    }
     tcp_work();
 }
 
 void all_stop_work() {
     tcp_stop_work();
+    StackFlows::stackflow_embed::stop_all();
     remote_server_stop_work();
 }
 
@@ -55,7 +104,6 @@ static void __sigint(int iSigNo) {
     main_exit_flage = 1;
     ALOGD("llm_sys stop");
     all_stop_work();
-    pthread_spin_destroy(&key_sql_lock);
 }
 
 void all_work_check() {
@@ -66,10 +114,6 @@ int main (int argc, char *argv[]) {
     signal(SIGTERM, __sigint);
     signal(SIGINT, __sigint);
     mkdir("/tmp/llm", 0777);
-    if (pthread_spin_init(&key_sql_lock, PTHREAD_PROCESS_PRIVATE) != 0) {
-        ALOGE("key_sql_lock init false");
-        exit(1);
-    }
     ALOGD("llm_sys start");
     get_run_config();
     all_work();
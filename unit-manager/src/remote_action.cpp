@@ -2,7 +2,9 @@
 #include <simdjson.h>
 
 #include "all.h"
+#include "json_parse_ctx.h"
 #include "remote_action.h"
+#include "remote_server.h"
 #include "pzmq.hpp"
 #include "json.hpp"
 #include "StackFlowUtil.h"
@@ -26,7 +28,8 @@ using namespace StackFlows;
 
     执行远程调用：
     创建 pzmq 客户端连接到对应的工作单元
-    调用远程的 action 方法，传递通信URL和原始JSON数据
+    异步调用远程的 action 方法，传递通信URL和原始JSON数据
+    不阻塞 TCP 的 I/O 线程等待单元的响应，调用失败（超时等）时在回调里给用户返回错误
  */
 
  /**
@@ -34,20 +37,33 @@ using namespace StackFlows;
   * json_str: JSON格式的请求数据，包含work_id和action
   */
 int remote_call(int com_id, const std::string &json_str) {
-    simdjson::ondemand::parser parser;
-    simdjson::padded_string json_string(json_str);
+    // 不经过 unit_action_match 的调用者使用线程私有的解析上下文，不再每次 new parser 和 padded_string
+    thread_local json_parse_ctx ctx;
     simdjson::ondemand::document doc;
-    auto error = parser.iterate(json_string).get(doc);
+    auto error = ctx.parser.iterate(ctx.load(json_str)).get(doc);
+    if (error) {
+        throw std::runtime_error("Invalid JSON");
+    }
 
+    std::string request_id;
+    doc["request_id"].get_string(request_id);
     std::string work_id;
     doc["work_id"].get_string(work_id);
-    std::string work_unit = work_id.substr(0, work_id.find("."));
     std::string action;
     doc["action"].get_string(action);
 
+    return remote_call(com_id, request_id, work_id, action, json_str);
+}
+
+/**
+ * unit_action_match 已经解析出了 request_id、work_id 和 action，直接传进来，不再解析第二遍
+ */
+int remote_call(int com_id, const std::string &request_id, const std::string &work_id,
+                const std::string &action, std::string_view json_str) {
     if (work_id.empty() || action.empty()) {
         throw std::runtime_error("Invalid JSON: missing work_id or action");
     }
+    std::string work_unit = sample_get_work_id_name(work_id);
     char com_url[256];
 
     /**
@@ -76,6 +92,11 @@ int remote_call(int com_id, const std::string &json_str) {
     pzmq clent(work_unit);
 
     // 打包操作:客户端相关url数据
-    return clent.call_rpc_action(action, pzmq_data::set_param(com_url, json_str),
-                                [](pzmq *_pzmq, const std::shared_ptr<pzmq_data> &val) {});
+    return clent.call_rpc_action_async(action, pzmq_data::set_param(com_url, json_str),
+                                [request_id, work_id, com_id](int ret, const std::shared_ptr<pzmq_data> &val) {
+                                    if (ret != 0) {
+                                        usr_print_error(request_id, work_id,
+                                                        "{\"code\":-9, \"message\":\"unit call false\"}", com_id);
+                                    }
+                                });
 }
\ No newline at end of file
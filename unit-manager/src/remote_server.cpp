@@ -13,13 +13,14 @@
 #include "remote_server.h"
 #include "zmq_bus.h"
 #include "json.hpp"
+#include "json_parse_ctx.h"
+#include "port_allocator.h"
 #include "remote_action.h"
 
 using namespace StackFlows;
 
 std::atomic<int> work_id_number_counter;
-int port_list_start;
-std::vector<bool> port_list;
+port_allocator unit_ports; // sys 服务多工作线程并发处理注册/释放，分配器内部加锁
 std::unique_ptr<pzmq> sys_rpc_server_;
 
 std::string sys_sql_select(const std::string &key) {
@@ -36,56 +37,76 @@ void sys_sql_unset(const std::string &key) {
     SAFE_ERASE(key);
 }
 
-unit_data *sys_allocate_unit(const std::string &unit) {
-    unit_data *unit_p = new unit_data();
+/**
+ * 根据端口号生成单元的 ZMQ URL
+ * 
+ * 实际效果
+ * 假设：
+    unit = "test"
+    zmq_s_format = "tcp://localhost:%d"
+    结果：make_unit_url(5001, "test", "output_url") = "tcp://localhost:5001"
+ * socket 文件格式会带上单元名和用途，如 "ipc:///tmp/llm/5001.sock.test.output_url"
+ */
+static std::string make_unit_url(int port, const std::string &unit, const char *usage) {
+    std::string zmq_format = zmq_s_format;
+
+    // 处理socket格式的特殊情况
+    if (zmq_s_format.find("sock") != std::string::npos) {
+        zmq_format += ".";
+        zmq_format += unit; // 添加单元名
+        zmq_format += ".";
+        zmq_format += usage;
+    }
+    std::vector<char> buff(zmq_format.length() + 16, 0);
+
+    // 生成完整的ZMQ URL
+    snprintf((char *)buff.data(), buff.size(), zmq_format.c_str(), port);
+    return std::string((char *)buff.data());
+}
+
+/**
+ * 为新的工作单元分配 work_id 和两个端口：
+ * output_port：单元的 PUB 输出，其他单元通过 "<work_id>.out_port" 查询后订阅
+ * inference_port：unit-manager 的 PUB，把用户的 inference 请求转发给单元
+ * 端口号直接保存在 unit_data 里，释放时直接归还，不再从 URL 反解
+ * 端口耗尽时返回 nullptr
+ *
+ * 单元记录的删除器在单元析构（关闭 PUB 套接字、停止发送线程）之后才归还端口：
+ * 释放单元时其他线程可能还持有它，端口要等最后一个使用者放手后再交给下一个单元
+ */
+std::shared_ptr<unit_data> sys_allocate_unit(const std::string &unit) {
+    int output_port = unit_ports.allocate();
+    int inference_port = unit_ports.allocate();
+    if ((output_port < 0) || (inference_port < 0)) {
+        unit_ports.release(output_port);
+        unit_ports.release(inference_port);
+        ALOGE("unit port exhausted, used:%d capacity:%d", unit_ports.used(), unit_ports.capacity());
+        return nullptr;
+    }
+
+    std::shared_ptr<unit_data> unit_p(new unit_data(), [](unit_data *p) {
+        int output_port = p->output_port_;
+        int inference_port = p->inference_port_;
+        delete p;
+        unit_ports.release(output_port);
+        unit_ports.release(inference_port);
+    });
     {
         unit_p->port_ = work_id_number_counter++;
         std::string ports = std::to_string(unit_p->port_);
         unit_p->work_id = unit + "." + ports;
     }
-
-    /**
-     * 为新创建的工作单元分配端口并生成输出URL
-     * 
-     * 实际效果
-     * 假设：
-        port_list_start = 5000
-        unit = "test"
-        zmq_s_format = "tcp://localhost:%d"
-        结果：unit_p->output_url = "tcp://localhost:5001"
-     */
-    {
-        int port;
-        for (size_t i = 0; i < port_list.size(); ++i) {
-            if (!port_list[i]) { // 找到未使用的端口
-                port = port_list_start + i; // 计算实际端口号
-                port_list[i] = true; // 标记为已使用
-                break;
-            }
-        }
-        std::string ports = std::to_string(port);
-        std::string zmq_format = zmq_s_format;
-
-        // 处理socket格式的特殊情况
-        if (zmq_s_format.find("sock") != std::string::npos) {
-            zmq_format += ".";
-            zmq_format += unit; // 添加单元名
-            zmq_format += ".output_url";
-        }
-        std::vector<char> buff(zmq_format.length() + ports.length(), 0);
-
-        // 生成完整的ZMQ URL
-        sprintf((char *)buff.data(), zmq_format.c_str(), port());
-        std::string zmq_s_url = std::string((char *)buff.data());
-        unit_p->output_url = zmq_s_url; // 保存到单元数据中
-    }
+    unit_p->output_port_ = output_port;
+    unit_p->inference_port_ = inference_port;
+    unit_p->output_url = make_unit_url(output_port, unit, "output_url");
+    unit_p->init_zmq(make_unit_url(inference_port, unit, "inference_url"));
 
     /**
      * 这段代码的作用是保存工作单元信息到全局存储中
      * 
      * 第一行：保存工作单元对象
      * 键：unit_p->work_id（如 "test.123"）
-     * 值：unit_p（工作单元对象指针）
+     * 值：unit_p（工作单元对象的 shared_ptr）
      * 作用：通过work_id可以找到对应的工作单元
      * 
      * 第二行：保存输出端口信息
@@ -98,7 +119,7 @@ unit_data *sys_allocate_unit(const std::string &unit) {
 
         存储的键值对：
 
-        "test.123" → 工作单元对象指针
+        "test.123" → 工作单元对象
         "test.123.out_port" → "tcp://localhost:5001"
 
      * 用途
@@ -111,28 +132,66 @@ unit_data *sys_allocate_unit(const std::string &unit) {
 }
 
 int sys_release_unit(const std::string &unit) {
-    unit_data *unit_p = NULL;
-    SAFE_READING(unit_p, unit_data *, unit);
-    if (NULL == unit_p) {
+    // 读取并删除在同一把锁内完成，并发释放同一个单元时只有一个调用者拿到记录
+    std::shared_ptr<unit_data> unit_p;
+    key_sql.take<std::shared_ptr<unit_data>>(unit, unit_p);
+    if (!unit_p) {
         return -1;
     }
 
-    int port;
-    sscanf(unit_p->output_url.c_str(), zmq_s_format.c_str(), &port);
-    port_list[port - port_list_start] = false;
-    sscanf(unit_p->inference_url.c_str(), zmq_s_format.c_str(), &port);
-    port_list[port - port_list_start] = false;
-
-    delete unit_p;
-    SAFE_ERASE(unit);
+    // 去掉表里的引用，单元在最后一个使用者放手后析构，
+    // 删除器先关闭单元的 PUB 套接字再归还端口，端口被重新分配时不会和旧套接字冲突
     SAFE_ERASE(unit + ".out_port");
+    unit_p.reset();
     return 0;
 }
 
-std::string rpc_allocate_unit(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &aw) {
-    unit_data *unit_info = sys_allocate_unit(raw->string());
-    return pzmq_data::set_param(std::to_string(unit_info->port),
-                                pzmq_data::set_param(unit_info->output_url, unit_info->inference_url));
+/**
+ * 返回三个字段：[work_id 编号][output_url][inference_url]
+ */
+std::string rpc_allocate_unit(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
+    std::shared_ptr<unit_data> unit_info = sys_allocate_unit(raw->string());
+    if (!unit_info) {
+        return pzmq_data::set_params({"-1", "", ""});
+    }
+    return pzmq_data::set_params({std::to_string(unit_info->port_), unit_info->output_url, unit_info->inference_url});
+}
+
+/**
+ * 端口分配器的统计信息，JSON 格式：
+ * {"capacity":544,"used":6,"peak":12,"allocated":40,"released":34,"exhausted":0}
+ */
+std::string rpc_port_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
+    nlohmann::json out_body;
+    out_body["capacity"] = unit_ports.capacity();
+    out_body["used"] = unit_ports.used();
+    out_body["peak"] = unit_ports.peak();
+    out_body["allocated"] = unit_ports.allocated();
+    out_body["released"] = unit_ports.released();
+    out_body["exhausted"] = unit_ports.exhausted();
+    return out_body.dump();
+}
+
+/**
+ * 单元发布队列的统计信息，参数为 work_id，JSON 格式：
+ * {"depth":0,"sent":1024,"dropped":0,"batches":37}
+ */
+std::string rpc_unit_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
+    std::shared_ptr<unit_data> unit_p;
+    SAFE_READING(unit_p, std::shared_ptr<unit_data>, raw->string());
+    if (!unit_p) {
+        return "{}";
+    }
+    nlohmann::json out_body;
+    out_body["depth"] = unit_p->queue_depth();
+    out_body["sent"] = unit_p->sent();
+    out_body["dropped"] = unit_p->dropped();
+    out_body["batches"] = unit_p->batches();
+    return out_body.dump();
+}
+
+std::string rpc_tcp_stats(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
+    return tcp_loop_stats();
 }
 
 std::string rpc_release_unit(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
@@ -145,12 +204,14 @@ std::string rpc_sql_select(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
 }
 
 std::string rpc_sql_set(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
-    std::string key = sample_json_str_get(raw->string(), "key");
-    std::string val = sample_json_str_get(raw->string(), "val");
+    std::string_view raw_view = raw->view();
+    auto fields = sample_json_fields_get(raw_view, {"key", "val"});
+    std::string key(fields[0]);
+    std::string val(fields[1]);
     if (key.empty()) {
-        return "False"
+        return "False";
     }
-    sys_sql_set("key, val");
+    sys_sql_set(key, val);
     return "Success";
 }
 
@@ -160,13 +221,21 @@ std::string rpc_sql_unset(pzmq *_pzmq, const std::shared_ptr<pzmq_data> &raw) {
 }
 
 void remote_server_work() {
-    int port_list_end;
+    int port_list_start = 0;
+    int port_list_end = 0;
+    int sys_rpc_workers = 4;
     SAFE_READING(work_id_number_counter, int , "config_work_id");
     SAFE_READING(port_list_start, int, "config_zmq_min_port");
     SAFE_READING(port_list_end, int , "config_zmq_max_port");
-    port_list.resize(port_list_end - port_list_start, 0);
+    SAFE_READING(sys_rpc_workers, int, "config_sys_rpc_workers");
+    unit_ports.init(port_list_start, port_list_end);
 
+    /**
+     * sys 服务使用多工作线程模式：
+     * 某个单元的 register_unit 等调用变慢时，不会阻塞 sql_select、list_action 等其它调用
+     */
     sys_rpc_server_ = std::make_unique<pzmq>("sys");
+    sys_rpc_server_->set_rpc_workers(sys_rpc_workers);
     sys_rpc_server_->register_rpc_action("sql_select",
                                         std::bind(rpc_sql_select,
                                         std::placeholders::_1, std::placeholders::_2));
@@ -182,6 +251,15 @@ void remote_server_work() {
     sys_rpc_server_->register_rpc_action("sql_unset",
                                         std::bind(rpc_sql_unset,
                                         std::placeholders::_1, std::placeholders::_2));
+    sys_rpc_server_->register_rpc_action("port_stats",
+                                        std::bind(rpc_port_stats,
+                                        std::placeholders::_1, std::placeholders::_2));
+    sys_rpc_server_->register_rpc_action("unit_stats",
+                                        std::bind(rpc_unit_stats,
+                                        std::placeholders::_1, std::placeholders::_2));
+    sys_rpc_server_->register_rpc_action("tcp_stats",
+                                        std::bind(rpc_tcp_stats,
+                                        std::placeholders::_1, std::placeholders::_2));
 }
 
 void remote_server_stop_work() {
@@ -211,16 +289,22 @@ void usr_print_error(const std::string &request_id, const std::string &work_id,
     zmq_com_send(zmq_out, out);
 }
 
-void unit_action_match(int com_id, const std::string &json_str) {
-    std::lock_guard<std::mutex> guard(unit_action_match_mtx);
-    simdjson::padded_string json_string(json_str);
-    simdjson::ondemand::document doc;
-    auto error = parser.iterate(json_string).get(doc);
+void unit_action_match(int com_id, std::string_view json_str) {
+    thread_local json_parse_ctx ctx;
+    unit_action_match(com_id, json_str, ctx);
+}
 
-    ALOGI("json format error:%s", hson_str.c_str());
+/**
+ * 解析用户请求并分发：
+ * 解析器和填充缓冲区来自 ctx（每个 TCP 会话一份），不同会话的请求在各自的 I/O 线程里并行解析，
+ * 不再经过全局锁
+ */
+void unit_action_match(int com_id, std::string_view json_str, json_parse_ctx &ctx) {
+    simdjson::ondemand::document doc;
+    auto error = ctx.parser.iterate(ctx.load(json_str)).get(doc);
 
     if (error) {
-        ALOGE("josn format error:%s", jspn_str.c_str());
+        ALOGE("json format error:%.*s", static_cast<int>(json_str.size()), json_str.data());
         usr_print_error("0", "sys", "{\"code\":-2, \"message\":\"json format error\"}", com_id);
         return;
     }
@@ -250,22 +334,10 @@ void unit_action_match(int com_id, const std::string &json_str) {
     /**
      * 这段代码的作用是解析work_id并根据action类型进行不同的处理
      * 第一部分：解析work_id
-     * 作用：把  work_id 按 . 分割成数组
-     * 例如："test.123" → ["test", "123"]
+     * 作用：取出单元名，不再把 work_id 按 . 逐字符切成数组
+     * 例如："test.123" → 单元名 "test"，"sys" → "sys"
      */
-    std::vector<std::string> work_id_fragment;
-    std::string fragment;
-    for (auto c : work_id) {
-        if (c != '.') {
-            fragment.push_back(c);
-        } else {
-            work_id_fragment.push_back(fragment);
-            fragment.clear();
-        }
-    }
-    if (fragment.length()) {
-        work_id_fragment.push_back(fragment);
-    }
+    std::string work_unit = sample_get_work_id_name(work_id);
 
     /**
      * 第二部分：根据action分别处理
@@ -277,20 +349,21 @@ void unit_action_match(int com_id, const std::string &json_str) {
      * 其他请求：通过RPC调用相应的服务方法
      */
     if (action == "inference") {
+        // 回复地址作为单独的路由帧，和原始请求一起发布，不再拼出一份带 zmq_com 的新请求
         char zmq_push_url[128];
-        int post = sprintf(zmq_push_url, zmq_c_format.c_str(), com_id);
-        std::string inference_raw_data;
-        inference_raw_data.resize(post + json_str.length() + 13);
-        post = sprintf(inference_raw_data.data(), "{\"zmq_com\":\"");
-        post += sprintf(inference_raw_data.data() + post, "%s", zmq_push_url);
-        post += spinrtf(inference_raw_data.data() + post, "\",");
-        memcpy(inference_raw_data.data() + post, json_str.data() + 1, json_str.length() - 1);
-        int ret = zmq_bus_publisher_push(work_id, inference_raw_data);
+        int post = snprintf(zmq_push_url, sizeof(zmq_push_url), zmq_c_format.c_str(), com_id);
+        // config_zmq_c_format 过长时 snprintf 返回的是需要的长度，不能直接当作视图长度
+        if ((post < 0) || (post >= static_cast<int>(sizeof(zmq_push_url)))) {
+            ALOGE("zmq push url too long, format:%s", zmq_c_format.c_str());
+            usr_print_error(request_id, work_id, "{\"code\":-4, \"message\":\"inference data push false\"}", com_id);
+            return;
+        }
+        int ret = zmq_bus_publisher_push(work_id, std::string_view(zmq_push_url, post), json_str);
         if (ret) {
             usr_print_error(request_id, work_id, "{\"code\":-4, \"message\":\"inference data push false\"}", com_id);
         }
     } else {
-        if ((work_id_fragment[0].length() != 0) && (remote_call(com_id, json_str) != 0)) {
+        if ((!work_unit.empty()) && (remote_call(com_id, request_id, work_id, action, json_str) != 0)) {
             usr_print_error(request_id, work_id, "{\"code\":-9, \"message\":\"unit call false\"}", com_id);
         }
     }
@@ -1,5 +1,7 @@
 #include <unordered_map>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include <chrono>
 #include <any>
 #include <cstring>
@@ -22,8 +24,118 @@ network::EventLoop loop;
 std::unique_ptr<netwrok::TcpServer> server;
 std::mutex context_mutex;
 
+/**
+ * 每个 I/O 事件循环的统计：
+ * 在线程初始化回调里登记，之后只增删计数，读取 tcp_loop_stats() 不影响事件循环
+ */
+struct tcp_loop_stat {
+    int index;
+    int cpu;
+    std::atomic<int> connections;
+    std::atomic<uint64_t> accepted;
+};
+std::mutex tcp_loop_stats_mtx;
+std::unordered_map<network::EventLoop *, std::unique_ptr<tcp_loop_stat>> tcp_loop_stats_;
+
+static tcp_loop_stat *get_loop_stat(network::EventLoop *ioloop) {
+    std::unique_lock<std::mutex> lock(tcp_loop_stats_mtx);
+    auto iteam = tcp_loop_stats_.find(ioloop);
+    return (iteam == tcp_loop_stats_.end()) ? nullptr : iteam->second.get();
+}
+
+/**
+ * 解析 CPU 列表，格式与 taskset 一致，如 "2,3" 或 "4-7"
+ */
+static std::vector<int> parse_cpu_list(const std::string &cpus) {
+    std::vector<int> out;
+    size_t pos = 0;
+    while (pos < cpus.length()) {
+        size_t next = cpus.find(',', pos);
+        std::string item = cpus.substr(pos, (next == std::string::npos) ? std::string::npos : next - pos);
+        int first = 0;
+        int last = 0;
+        int n = sscanf(item.c_str(), "%d-%d", &first, &last);
+        if (n == 1) {
+            last = first;
+        }
+        for (int cpu = first; (n > 0) && (cpu <= last); ++cpu) {
+            out.push_back(cpu);
+        }
+        if (next == std::string::npos) {
+            break;
+        }
+        pos = next + 1;
+    }
+    return out;
+}
+
+/**
+ * I/O 线程初始化：
+ * config_tcp_cpus 不为空时，第 i 个 I/O 线程绑定到列表中的第 (i % n) 个 CPU，网络线程和推理核隔离开
+ * config_tcp_sched_fifo 大于 0 时，I/O 线程使用 SCHED_FIFO 实时调度，值为优先级（需要权限，失败只打印告警）
+ */
+static void tcp_thread_init(network::EventLoop *ioloop) {
+    static std::atomic<int> thread_index(0);
+    std::string cpus;
+    int fifo_priority = 0;
+    SAFE_READING(cpus, std::string, "config_tcp_cpus");
+    SAFE_READING(fifo_priority, int, "config_tcp_sched_fifo");
+
+    auto stat = std::make_unique<tcp_loop_stat>();
+    stat->index = thread_index++;
+    stat->cpu = -1;
+    stat->connections = 0;
+    stat->accepted = 0;
+
+    std::vector<int> cpu_list = parse_cpu_list(cpus);
+    if (!cpu_list.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu_list[stat->index % cpu_list.size()], &cpuset);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0) {
+            stat->cpu = cpu_list[stat->index % cpu_list.size()];
+        } else {
+            ALOGW("tcp io thread %d set affinity false", stat->index);
+        }
+    }
+    if (fifo_priority > 0) {
+        struct sched_param param;
+        param.sched_priority = fifo_priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+            ALOGW("tcp io thread %d set SCHED_FIFO false", stat->index);
+        }
+    }
+    ALOGI("tcp io thread %d start, cpu:%d", stat->index, stat->cpu);
+
+    std::unique_lock<std::mutex> lock(tcp_loop_stats_mtx);
+    tcp_loop_stats_[ioloop] = std::move(stat);
+}
+
+/**
+ * 各 I/O 事件循环的连接统计，JSON 格式：
+ * [{"loop":0,"cpu":2,"connections":3,"accepted":10},...]
+ */
+std::string tcp_loop_stats() {
+    nlohmann::json out_body = nlohmann::json::array();
+    std::unique_lock<std::mutex> lock(tcp_loop_stats_mtx);
+    for (auto &iteam : tcp_loop_stats_) {
+        nlohmann::json loop_body;
+        loop_body["loop"] = iteam.second->index;
+        loop_body["cpu"] = iteam.second->cpu;
+        loop_body["connections"] = iteam.second->connections.load();
+        loop_body["accepted"] = iteam.second->accepted.load();
+        out_body.push_back(loop_body);
+    }
+    return out_body.dump();
+}
+
 void onConnection(const network::TcpConnectionPtr &conn) {
+    tcp_loop_stat *stat = get_loop_stat(conn->getLoop());
     if (conn->connected()) {
+        if (stat) {
+            stat->connections++;
+            stat->accepted++;
+        }
         std::shared_ptr<TcpSession> session = std::make_shared<TcpSession>(conn);
         conn->setContext(session);
         session->work(zmq_s_format, counter_port.fetch_add(1));
@@ -32,6 +144,9 @@ void onConnection(const network::TcpConnectionPtr &conn) {
             counter_port = 8000;
         }
     } else {
+        if (stat) {
+            stat->connections--;
+        }
         try {
             auto session = boost::any_cast<std::shared_ptr<TcpSession>>(conn->getContext());
             session->stop();
@@ -41,13 +156,20 @@ void onConnection(const network::TcpConnectionPtr &conn) {
     }
 }
 
-void onMessage (const network::TcpConnectionPtr &conn, network::Buffer &buf) {
-    std::string msg(buf->retrieveAllAsString());
-
+/**
+ * 直接在接收缓冲区上分帧，每条完整的请求都会被分发，不完整的尾部留在缓冲区里等后续数据
+ * 帧格式错误（超长）时关闭连接
+ */
+void onMessage(const network::TcpConnectionPtr &conn, network::Buffer *buf) {
     try {
         auto session = boost::any_cast<std::shared_ptr<TcpSession>>(conn->getContext());
-        session->select_json_str(msg, std::bind(&TcpSession::on_data, session, 
-                                std::placeholders::_1));
+        long consumed = session->feed(buf->peek(), buf->readableBytes());
+        if (consumed < 0) {
+            buf->retrieveAll();
+            conn->shutdown();
+            return;
+        }
+        buf->retrieve(consumed);
     } catch (const boost::bad_any_cast &e) {
         std::cerr << "Type cast error: " << e.what() << std::endl;
     }
@@ -61,7 +183,12 @@ void tcp_work() {
 
     server->setConnectionCallback(onConnection);
     server->setMessageCallback(onMessage);
-    server->setThreadNum(2);
+
+    // I/O 线程数由 config_tcp_threads 配置，默认 2
+    int tcp_threads = 2;
+    SAFE_READING(tcp_threads, int, "config_tcp_threads");
+    server->setThreadInitCallback(tcp_thread_init);
+    server->setThreadNum(tcp_threads);
 
     server->start();
     loop.loop();
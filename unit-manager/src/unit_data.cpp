@@ -1,3 +1,7 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "all.h"
 #include "unit_data.h"
 
 /**
@@ -5,19 +9,130 @@
  * 提供简单的初始化、发送消息和资源清理接口。
  * 主要用于单元间的消息发布通信。
  */
-unit_data::unit_data() {
-
+unit_data::unit_data()
+    : queue_hwm_(1024), queue_policy_(QUEUE_DROP_NEW), sender_fd_(-1), sender_sleep_(false),
+      sender_exit_(false), sent_(0), dropped_(0), batches_(0), port_(0), output_port_(-1), inference_port_(-1) {
+    std::string policy;
+    SAFE_READING(queue_hwm_, int, "config_unit_queue_hwm");
+    SAFE_READING(policy, std::string, "config_unit_queue_policy");
+    if (policy == "drop_old") {
+        queue_policy_ = QUEUE_DROP_OLD;
+    }
 }
 
+/**
+ * 创建 PUB 套接字并启动发送线程，套接字只在发送线程里使用
+ */
 void unit_data::init_zmq(const std::string &url) {
     inference_url = url;
     user_inference_chennal_ = std::make_unique<pzmq>(inference_url, ZMQ_PUB);
+    sender_fd_ = eventfd(0, EFD_CLOEXEC);
+    sender_thread_ = std::make_unique<std::thread>(std::bind(&unit_data::sender_loop, this));
+}
+
+/**
+ * 入队后只有发送线程在睡眠时才写 eventfd 唤醒它，突发请求只需要一次唤醒
+ */
+int unit_data::enqueue(publish_msg &&msg) {
+    if (!sender_thread_) {
+        return -1;
+    }
+    if ((queue_policy_ == QUEUE_DROP_NEW) && (queue_.size() >= queue_hwm_)) {
+        dropped_++;
+        return -1;
+    }
+    queue_.push(std::move(msg));
+    if (sender_sleep_.exchange(false)) {
+        uint64_t count = 1;
+        ssize_t ret = write(sender_fd_, &count, sizeof(count));
+        (void)ret;
+    }
+    return 0;
 }
 
-void unit_data::send_msg(const std::string &json_str) {
-    user_inference_chennal_->send_data(json_str);
+int unit_data::send_msg(const std::string &json_str) {
+    return enqueue(publish_msg{std::make_shared<const std::string>(json_str), 0});
+}
+
+/**
+ * 转发用户的 inference 请求：[zmq_com][原始请求] 两帧发送，原始请求不做任何改写
+ * 两帧一次拷贝进同一个数据块，发送线程里不再拷贝 body
+ */
+int unit_data::send_msg(std::string_view zmq_com, std::string_view json_str) {
+    std::string blob;
+    blob.reserve(zmq_com.size() + json_str.size());
+    blob.append(zmq_com.data(), zmq_com.size());
+    blob.append(json_str.data(), json_str.size());
+    return enqueue(publish_msg{std::make_shared<const std::string>(std::move(blob)), zmq_com.size()});
+}
+
+/**
+ * 发送线程：
+ * 1. 一次唤醒取空队列，整批依次发送，突发的请求只付出一次唤醒和调度的代价
+ * 2. 队列为空时先标记睡眠再检查一次队列，避免和入队方错过唤醒
+ * 3. QUEUE_DROP_OLD 策略下，积压超过高水位时丢弃最旧的消息
+ */
+void unit_data::sender_loop() {
+    pthread_setname_np(pthread_self(), "unit_sender");
+
+    publish_msg msg;
+    while (!sender_exit_.load()) {
+        int count = 0;
+        while (queue_.pop(msg)) {
+            if ((queue_policy_ == QUEUE_DROP_OLD) && (queue_.size() >= queue_hwm_)) {
+                dropped_++;
+                continue;
+            }
+            user_inference_chennal_->send_data(msg.blob, msg.head_len);
+            msg.blob.reset();
+            count++;
+        }
+        if (count) {
+            sent_ += count;
+            batches_++;
+        }
+
+        sender_sleep_.store(true);
+        if (!queue_.empty() || sender_exit_.load()) {
+            // 生产者已经计数但还没有完成链接时让出 CPU，下一轮再取
+            if (!sender_sleep_.exchange(false)) {
+                uint64_t wake;
+                ssize_t ret = read(sender_fd_, &wake, sizeof(wake));
+                (void)ret;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        uint64_t wake;
+        ssize_t ret = read(sender_fd_, &wake, sizeof(wake));
+        (void)ret;
+    }
+}
+
+long unit_data::queue_depth() const {
+    return queue_.size();
+}
+
+uint64_t unit_data::sent() const {
+    return sent_.load();
+}
+
+uint64_t unit_data::dropped() const {
+    return dropped_.load();
+}
+
+uint64_t unit_data::batches() const {
+    return batches_.load();
 }
 
 unit_data::~unit_data() {
+    if (sender_thread_) {
+        sender_exit_.store(true);
+        uint64_t count = 1;
+        ssize_t ret = write(sender_fd_, &count, sizeof(count));
+        (void)ret;
+        sender_thread_->join();
+        close(sender_fd_);
+    }
     user_inference_chennal_.reset();
-}
\ No newline at end of file
+}
@@ -5,6 +5,7 @@
 
 #include "all.h"
 #include "zmq_bus.h"
+#include "pzmq_push_cache.hpp"
 
 #if defined(__ARM_NEON) || defined(__ARM_NEON__)
 #include <arm_neon.h>
@@ -19,7 +20,21 @@ using namespace StackFlows;
 zmq_bus_com::zmq_bus_com() {
     exit_flage = 1;
     err_count = 0;
-    json_str_flage_ = 0;
+    frame_mode_ = FRAME_AUTO;
+    max_frame_size_ = 1024 * 1024;
+    line_scanned_ = 0;
+    json_depth_ = 0;
+    json_in_string_ = false;
+    json_escape_ = false;
+
+    // 先读到 int 里检查：0 会拒绝所有长度帧，负数转成 size_t 后会关掉超长保护，都保持默认的 1 MiB
+    int max_frame_size = static_cast<int>(max_frame_size_);
+    SAFE_READING(max_frame_size, int, "config_tcp_max_frame");
+    if (max_frame_size > 0) {
+        max_frame_size_ = max_frame_size;
+    } else {
+        ALOGW("invalid config_tcp_max_frame:%d, use %zu", max_frame_size, max_frame_size_);
+    }
 }
 
 void zmq_bus_com::work(const std::string &zmq_url_format, int port) {
@@ -31,21 +46,119 @@ void zmq_bus_com::work(const std::string &zmq_url_format, int port) {
     _zmq_url = std::string((char *)buff.data());
     user_chennal_ = 
         std::make_unique<pzmq>(_zmq_url, ZMQ_PULL, [this](pzmq *_pzmq, const std::shared_ptr<pzmq_data> &data) {
-            this->send_data(data->string());
+            this->send_data(data->view());
         });
 }
 
 void zmq_bus_com::stop() {
     exit_flage = 0;
     user_chennal_.reset();
+
+    // 会话的 PULL 已经关闭，丢弃指向它的缓存 PUSH 套接字，端口复用时不会串到新会话
+    char zmq_push_url[128];
+    sprintf(zmq_push_url, zmq_c_format.c_str(), _port);
+    pzmq_push_cache::instance().erase(zmq_push_url);
 }
 
-void zmq_bus_com::on_data(const std::string &data) {
-    std::cout << "on_data:" << data << std::endl;
-    unit_action_match(_port, data);
+void zmq_bus_com::on_data(std::string_view data) {
+    unit_action_match(_port, data, json_ctx_);
 }
 
-void zmq_bus_com::send_data(const std::string &data) {
+static inline bool is_frame_space(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+/**
+ * 从 data 中取出所有完整的帧逐个分发，返回消费的字节数，协议错误返回 -1
+ * data 通常直接指向 TCP 接收缓冲区，分发是同步的，返回后调用者再从缓冲区中移除已消费的部分
+ */
+long zmq_bus_com::feed(const char *data, size_t len) {
+    const char *pos = data;
+    const char *end = data + len;
+
+    if ((frame_mode_ == FRAME_AUTO) && (pos < end)) {
+        frame_mode_ = (*pos == '\0') ? FRAME_LENGTH : FRAME_LINE;
+    }
+
+    if (frame_mode_ == FRAME_LENGTH) {
+        while (end - pos >= 4) {
+            const unsigned char *head = reinterpret_cast<const unsigned char *>(pos);
+            size_t frame_len = (static_cast<size_t>(head[0]) << 24) | (static_cast<size_t>(head[1]) << 16) |
+                               (static_cast<size_t>(head[2]) << 8) | static_cast<size_t>(head[3]);
+            if (frame_len > max_frame_size_) {
+                ALOGE("tcp frame too large:%zu", frame_len);
+                return -1;
+            }
+            if (static_cast<size_t>(end - pos - 4) < frame_len) {
+                break;
+            }
+            if (frame_len) {
+                on_data(std::string_view(pos + 4, frame_len));
+            }
+            pos += 4 + frame_len;
+        }
+        return pos - data;
+    }
+
+    /**
+     * FRAME_LINE：一帧在下面两种情况下结束
+     * 1. 顶层的 JSON 对象/数组的括号闭合（不需要换行，对象内部的换行不会把它切开，多行缩进的 JSON 也能收）
+     * 2. 不在括号内的换行（换行分隔的请求、非 JSON 的内容交给 on_data 报 json format error）
+     * 扫描状态（括号深度、是否在字符串里）保存在会话里，不完整的尾部下次接着扫，已扫描的字节不会重扫
+     */
+    const char *scan = pos + line_scanned_;
+    while (scan < end) {
+        char c = *scan++;
+        const char *frame_end = nullptr;
+        if (c == '\n') {
+            // JSON 字符串里不会有裸换行，在字符串里遇到说明内容本身不合法，结束字符串状态
+            json_in_string_ = false;
+            json_escape_ = false;
+            if (json_depth_ == 0) {
+                frame_end = scan - 1;
+            }
+        } else if (json_in_string_) {
+            if (json_escape_) {
+                json_escape_ = false;
+            } else if (c == '\\') {
+                json_escape_ = true;
+            } else if (c == '"') {
+                json_in_string_ = false;
+            }
+        } else if (c == '"') {
+            json_in_string_ = true;
+        } else if ((c == '{') || (c == '[')) {
+            json_depth_++;
+        } else if ((c == '}') || (c == ']')) {
+            if ((json_depth_ > 0) && (--json_depth_ == 0)) {
+                frame_end = scan;
+            }
+        }
+        if (frame_end == nullptr) {
+            continue;
+        }
+        const char *frame_start = pos;
+        while ((frame_start < frame_end) && is_frame_space(*frame_start)) {
+            ++frame_start;
+        }
+        while ((frame_end > frame_start) && is_frame_space(frame_end[-1])) {
+            --frame_end;
+        }
+        if (frame_end > frame_start) {
+            on_data(std::string_view(frame_start, frame_end - frame_start));
+        }
+        pos = scan;
+        json_depth_ = 0;
+    }
+    line_scanned_ = scan - pos;
+    if (line_scanned_ > max_frame_size_) {
+        ALOGE("tcp line too long:%zu", line_scanned_);
+        return -1;
+    }
+    return pos - data;
+}
+
+void zmq_bus_com::send_data(std::string_view data) {
 
 }
 
@@ -55,24 +168,25 @@ zmq_bus_com::~zmq_bus_com() {
     }
 }
 
-int zmq_bus_publisher_push(const std::string &work_id, const std::string &json_str) {
-    ALOGW("zmq_bus_publisher_push json_str:%s", json_str.c_str());
-
+/**
+ * 把用户的 inference 请求发布给 work_id 对应的单元：
+ * zmq_com（用户会话的 PULL 地址）作为路由帧，原始请求作为负载帧，客户端的字节原样转发，不再拼接一份新的请求
+ */
+int zmq_bus_publisher_push(const std::string &work_id, std::string_view zmq_com, std::string_view json_str) {
     if (work_id.empty()) {
         ALOGW("work_id is empty");
         return -1;
     }
-    unit_data *unit_p = NULL;
-    SAFE_READING(unit_p, unit_data *, work_id);
-    if (unit_p) {
-        unit_p->send_msg(json_str);
-    }
-    ALOGW("zmq_bus_publisher_push_work_id:%s", work_id.c_str());
-    else {
+    // 持有单元的引用计数，发送期间并发的 release_unit 不会把单元析构掉
+    std::shared_ptr<unit_data> unit_p;
+    SAFE_READING(unit_p, std::shared_ptr<unit_data>, work_id);
+    if (!unit_p) {
         ALOGW("zmq_bus_publisher_push failed, not have work_id:%s", work_id.c_str());
         return -1;
     }
-    return 0;
+
+    // 放进单元的发布队列，队列超过高水位时返回 -1
+    return unit_p->send_msg(zmq_com, json_str);
 }
 
 void *usr_context;
@@ -80,16 +194,6 @@ void *usr_context;
 void zmq_com_send(int com_id, const std::string &out_str) {
     char zmq_push_url[128];
     sprintf(zmq_push_url, zmq_c_format.c_str(), com_id);
-    pzmq _zmq(zmq_push_url, ZMQ_PUSH);
     std::string out = out_str + "\n";
-    _zmq.send_data(out);
+    pzmq_push_cache::instance().send(zmq_push_url, std::move(out));
 }
-
-void zmq_bus_com::select_json_str(const std::string &json_src, std::function<void(const std::string &)> out_fun) {
-    std::string test_json = json_src;
-
-    if (!test_json.empty() && test_json.back() == '\n') {
-        test_json.pop_back();
-    }
-    out_fun(test_json);
-}
\ No newline at end of file